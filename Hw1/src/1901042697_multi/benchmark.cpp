@@ -0,0 +1,257 @@
+#include <iostream>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <sstream>
+
+#include "./include/thread_safe_set.hpp"
+#include "./include/balanced_thread_safe_set.hpp"
+#include "./include/concurrent_skip_list_set.hpp"
+#include "./include/epoch_thread_safe_set.hpp"
+#include "./include/persistent_thread_safe_set.hpp"
+#include "./include/sharded_thread_safe_set.hpp"
+#include "./include/concurrent_hash_set.hpp"
+#include "./include/blink_tree_set.hpp"
+#include "./include/workload.hpp"
+
+
+/*
+    Workload benchmark for capacity tests: num threads run a read / insert / remove mix over a key space for a
+    fixed time after a warmup and every operation is timed. Prints one CSV row per operation type, plus "all".
+
+    usage: ./benchmark [--set tree] [--threads 4] [--mix 80/10/10] [--keys 100000] [--dist uniform]
+                       [--theta 0.99] [--prefill 0.5] [--duration 2000] [--warmup 500] [--seed 437] [--no-header]
+
+    --set       tree, coupling, combining, optimistic, avl, skiplist, epoch, persistent, shards, hash, blink
+    --mix       read/insert/remove percentages, must add up to 100
+    --dist      uniform, sequential or zipfian (theta is the zipfian skew)
+    --prefill   fraction of the key space inserted before the run
+    --duration  measured milliseconds, --warmup runs the same mix unmeasured before it
+*/
+
+
+struct Config
+{
+    std::string set = "tree";
+    int threads = 4;
+    int readPercent = 80;
+    int insertPercent = 10;
+    int removePercent = 10;
+    std::uint64_t keys = 100000;
+    mbu::KeyDistribution distribution = mbu::KeyDistribution::Uniform;
+    double theta = 0.99;
+    double prefill = 0.5;
+    int durationMs = 2000;
+    int warmupMs = 500;
+    std::uint64_t seed = 437;
+    bool header = true;
+};
+
+
+enum Op { Read, Insert, Remove, OPS };
+const char* OP_NAMES[OPS] = {"read", "insert", "remove"};
+
+struct ThreadResult
+{
+    std::uint64_t ops[OPS] = {};
+    std::uint64_t hits[OPS] = {};
+    mbu::LatencyHistogram latency[OPS];
+};
+
+
+template <class Set>
+void runBenchmark(Set& set, const Config& config){
+
+    // prefill a random subset of the key space
+    std::vector<int> keys(config.keys);
+    std::iota(begin(keys), end(keys), 0);
+    std::shuffle(begin(keys), end(keys), std::mt19937_64(config.seed));
+    keys.resize(static_cast<std::size_t>(config.prefill * config.keys));
+    for(int key : keys){
+        set.insert(key);
+    }
+    keys = std::vector<int>();
+
+    std::unique_ptr<mbu::ZipfianTable> zipfian;
+    if(config.distribution == mbu::KeyDistribution::Zipfian){
+        zipfian = std::make_unique<mbu::ZipfianTable>(config.keys, config.theta);
+    }
+
+    // 0 warmup, 1 measuring, 2 stop
+    std::atomic<int> phase = 0;
+    std::vector<ThreadResult> results(config.threads);
+    std::vector<std::thread> threads;
+
+    for(int t = 0; t < config.threads; ++t){
+        threads.push_back(std::thread([&, t](){
+            mbu::KeyGenerator generator(config.distribution, config.keys, zipfian.get(), t, config.threads, config.seed);
+            ThreadResult& result = results[t];
+            int current;
+            while((current = phase.load(std::memory_order_relaxed)) != 2){
+
+                int key = static_cast<int>(generator());
+                int dice = generator.percent();
+                Op op = dice < config.readPercent ? Read : dice < config.readPercent + config.insertPercent ? Insert : Remove;
+
+                auto start = std::chrono::steady_clock::now();
+                bool hit = op == Read ? set.search(key) : op == Insert ? set.insert(key) : set.remove(key);
+                auto end = std::chrono::steady_clock::now();
+
+                if(current == 1){
+                    ++result.ops[op];
+                    result.hits[op] += hit;
+                    result.latency[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                }
+            }
+        }));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.warmupMs));
+    auto start = std::chrono::steady_clock::now();
+    phase.store(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.durationMs));
+    phase.store(2);
+    auto end = std::chrono::steady_clock::now();
+    for(auto& thread : threads)
+        thread.join();
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    ThreadResult total;
+    mbu::LatencyHistogram all;
+    for(const ThreadResult& result : results){
+        for(int op = 0; op < OPS; ++op){
+            total.ops[op] += result.ops[op];
+            total.hits[op] += result.hits[op];
+            total.latency[op] += result.latency[op];
+            all += result.latency[op];
+        }
+    }
+
+    if(config.header){
+        std::cout << "set,threads,mix,keys,dist,duration_ms,op,ops,hit_rate,ops_per_sec,p50_ns,p99_ns,p999_ns,final_size" << std::endl;
+    }
+    auto row = [&](const std::string& name, std::uint64_t ops, std::uint64_t hits, const mbu::LatencyHistogram& latency){
+        std::cout << config.set << "," << config.threads << ","
+                  << config.readPercent << "/" << config.insertPercent << "/" << config.removePercent << ","
+                  << config.keys << "," << mbu::distributionName(config.distribution) << "," << ms << ","
+                  << name << "," << ops << "," << (ops ? double(hits) / ops : 0.0) << "," << ops * 1000.0 / ms << ","
+                  << latency.percentile(0.5) << "," << latency.percentile(0.99) << "," << latency.percentile(0.999) << ","
+                  << set.size() << std::endl;
+    };
+    std::uint64_t allOps = 0, allHits = 0;
+    for(int op = 0; op < OPS; ++op){
+        if(total.ops[op] != 0){
+            row(OP_NAMES[op], total.ops[op], total.hits[op], total.latency[op]);
+        }
+        allOps += total.ops[op];
+        allHits += total.hits[op];
+    }
+    row("all", allOps, allHits, all);
+}
+
+
+Config parseArguments(int argc, char* argv[]){
+
+    Config config;
+    for(int i = 1; i < argc; ++i){
+        std::string option = argv[i];
+        if(option == "--no-header"){
+            config.header = false;
+            continue;
+        }
+        if(i + 1 >= argc){
+            throw std::invalid_argument("missing value for " + option);
+        }
+        std::string value = argv[++i];
+
+        if(option == "--set")               config.set = value;
+        else if(option == "--threads")      config.threads = std::stoi(value);
+        else if(option == "--keys")         config.keys = std::stoull(value);
+        else if(option == "--dist")         config.distribution = mbu::parseDistribution(value);
+        else if(option == "--theta")        config.theta = std::stod(value);
+        else if(option == "--prefill")      config.prefill = std::stod(value);
+        else if(option == "--duration")     config.durationMs = std::stoi(value);
+        else if(option == "--warmup")       config.warmupMs = std::stoi(value);
+        else if(option == "--seed")         config.seed = std::stoull(value);
+        else if(option == "--mix"){
+            char slash;
+            std::istringstream stream(value);
+            if(!(stream >> config.readPercent >> slash >> config.insertPercent >> slash >> config.removePercent)){
+                throw std::invalid_argument("--mix takes read/insert/remove, e.g. 80/10/10");
+            }
+        }
+        else throw std::invalid_argument("unknown option " + option);
+    }
+
+    if(config.readPercent < 0 || config.insertPercent < 0 || config.removePercent < 0 ||
+       config.readPercent + config.insertPercent + config.removePercent != 100){
+        throw std::invalid_argument("--mix percentages must add up to 100");
+    }
+    if(config.threads < 1 || config.keys < 2 || config.keys > std::uint64_t(std::numeric_limits<int>::max())){
+        throw std::invalid_argument("need at least 1 thread and 2 .. INT_MAX keys");
+    }
+    if(config.prefill < 0 || config.prefill > 1 || config.theta <= 0 || config.theta == 1){
+        throw std::invalid_argument("--prefill must be in [0, 1] and --theta in (0, 1) or above 1");
+    }
+    return config;
+}
+
+
+int main(int argc, char* argv[]){
+
+    Config config;
+    try{
+        config = parseArguments(argc, argv);
+    }catch(const std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if(config.set == "tree"){
+        mbu::ThreadSafeSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "coupling"){
+        mbu::ThreadSafeSet<int> set(mbu::LockMode::Coupling);
+        runBenchmark(set, config);
+    }else if(config.set == "combining"){
+        mbu::ThreadSafeSet<int> set(mbu::LockMode::Combining);
+        runBenchmark(set, config);
+    }else if(config.set == "optimistic"){
+        mbu::ThreadSafeSet<int> set(mbu::LockMode::Global, mbu::ReadMode::Optimistic);
+        runBenchmark(set, config);
+    }else if(config.set == "avl"){
+        mbu::BalancedThreadSafeSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "skiplist"){
+        mbu::ConcurrentSkipListSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "epoch"){
+        mbu::EpochThreadSafeSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "persistent"){
+        mbu::PersistentThreadSafeSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "shards"){
+        mbu::ShardedThreadSafeSet<int, 8> set;
+        runBenchmark(set, config);
+    }else if(config.set == "hash"){
+        mbu::ConcurrentHashSet<int> set;
+        runBenchmark(set, config);
+    }else if(config.set == "blink"){
+        mbu::BLinkTreeSet<int> set;
+        runBenchmark(set, config);
+    }else{
+        std::cerr << "unknown set " << config.set << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+#ifndef BALANCED_THREAD_SAFE_SET_HPP__
+#define BALANCED_THREAD_SAFE_SET_HPP__
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+#include "macros.hpp"
+#include "requirements.hpp"
+
+
+namespace mbu{
+
+/*
+    AVL balanced sibling of ThreadSafeSet with the same interface.
+
+    Writers are serialized by flag and keep the height O(log n) for any key order (sorted sequence ids included).
+    Readers never lock, a rotation builds fresh nodes and publishes them with a single store into the parent link
+    so a reader standing anywhere in the tree keeps reaching every key that was there when it started.
+    The one change that can hide a key, a remove moving the successor up, is bracketed by moves: a miss or an
+    in order walk that overlapped it is repeated, under flag after READ_RETRIES attempts.
+    Every traversal is iterative so deep trees can not overflow the stack.
+*/
+template <class T>
+class BalancedThreadSafeSet
+{
+    struct Node;
+
+    static constexpr int READ_RETRIES = 8;
+
+public:
+
+    BalancedThreadSafeSet(){
+        static_assert(has_less_than<T>, "T must have operator<");
+        static_assert(has_equal_to<T>, "T must have operator==");
+    }
+    ~BalancedThreadSafeSet(){
+        clear();
+    }
+
+    BalancedThreadSafeSet(const BalancedThreadSafeSet& other) = delete;
+    BalancedThreadSafeSet& operator=(const BalancedThreadSafeSet& other) = delete;
+
+    BalancedThreadSafeSet(BalancedThreadSafeSet&& other){
+        root.store(other.root.load());
+        other.root.store(nullptr);
+    };
+
+    BalancedThreadSafeSet& operator=(BalancedThreadSafeSet&& other){
+        root.store(other.root.load());
+        other.root.store(nullptr);
+        return *this;
+    };
+
+
+    bool insert(const T& value){
+
+        ATOMIC_FLAG_LOCK(flag);
+        std::vector<std::shared_ptr<Node>> path;
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr){
+            if(value == current->value){
+                ATOMIC_FLAG_UNLOCK(flag);
+                return false;
+            }
+            path.push_back(current);
+            current = value < current->value ? current->left.load() : current->right.load();
+        }
+
+        std::shared_ptr<Node> node = std::make_shared<Node>(value);
+        if(path.empty()){
+            root.store(node);
+        }else if(value < path.back()->value){
+            path.back()->left.store(node);
+        }else{
+            path.back()->right.store(node);
+        }
+
+        rebalance(path);
+        ATOMIC_FLAG_UNLOCK(flag);
+        return true;
+    }
+
+    bool remove(const T& value){
+
+        ATOMIC_FLAG_LOCK(flag);
+        std::vector<std::shared_ptr<Node>> path;
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr && !(value == current->value)){
+            path.push_back(current);
+            current = value < current->value ? current->left.load() : current->right.load();
+        }
+        if(current == nullptr){
+            ATOMIC_FLAG_UNLOCK(flag);
+            return false;
+        }
+
+        std::shared_ptr<Node> parent = path.empty() ? nullptr : path.back();
+        std::shared_ptr<Node> left = current->left.load();
+        std::shared_ptr<Node> right = current->right.load();
+
+        if(left == nullptr || right == nullptr){
+            replaceChild(parent, current, left != nullptr ? left : right);
+        }else{
+            /*
+                Publish a copy holding the successor first, then detach the successor below it. A reader already
+                below current misses the successor in between, moves is odd meanwhile and sends it back.
+            */
+            moves.fetch_add(1);
+            std::shared_ptr<Node> successor = right;
+            while(successor->left.load() != nullptr){
+                successor = successor->left.load();
+            }
+
+            std::shared_ptr<Node> replacement = std::make_shared<Node>(successor->value);
+            replacement->left.store(left);
+            replacement->right.store(right);
+            replacement->height = current->height;
+            replaceChild(parent, current, replacement);
+
+            path.push_back(replacement);
+            for(std::shared_ptr<Node> n = right; n != successor; n = n->left.load()){
+                path.push_back(n);
+            }
+            replaceChild(path.back(), successor, successor->right.load());
+            moves.fetch_add(1);
+        }
+
+        rebalance(path);
+        ATOMIC_FLAG_UNLOCK(flag);
+        return true;
+    }
+
+    // A hit is taken as it is, only a miss is validated against moves
+    bool search(const T& value) const {
+
+        for(int attempt = 0; attempt < READ_RETRIES; ++attempt){
+            std::uint64_t version = moves.load(std::memory_order_acquire);
+            if(find(value)){
+                return true;
+            }
+            if(unmoved(version)){
+                return false;
+            }
+        }
+        ATOMIC_FLAG_LOCK(flag);
+        bool found = find(value);
+        ATOMIC_FLAG_UNLOCK(flag);
+        return found;
+    }
+
+    int size() const {
+        int count = 0;
+        iterate([&count](const T&){ ++count; });
+        return count;
+    }
+
+    bool empty() const {
+        return root.load() == nullptr;
+    }
+
+    void clear() {
+        ATOMIC_FLAG_LOCK(flag);
+        root.store(nullptr);
+        ATOMIC_FLAG_UNLOCK(flag);
+    }
+
+    /*
+        In order walk with an explicit stack. moves is checked before every key, when a successor moved meanwhile
+        the stack is rebuilt from the root for the keys above the last one reported; after READ_RETRIES rebuilds in
+        a row one is done under flag (func is not called under it). A key that stays in the set is reported once.
+    */
+    void iterate(const std::function<void(const T&)>& func) const {
+
+        std::vector<std::shared_ptr<Node>> stack;
+        std::shared_ptr<Node> last;
+        auto descend = [&](std::shared_ptr<Node> current){
+            while(current != nullptr){
+                if(last != nullptr && !(last->value < current->value)){
+                    current = current->right.load();
+                }else{
+                    stack.push_back(current);
+                    current = current->left.load();
+                }
+            }
+        };
+
+        std::uint64_t version = moves.load(std::memory_order_acquire);
+        descend(root.load());
+        int attempt = 0;
+        bool trusted = false;
+        while(true){
+            if(!trusted && !unmoved(version)){
+                stack.clear();
+                if(++attempt < READ_RETRIES){
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load());
+                }else{
+                    ATOMIC_FLAG_LOCK(flag);
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load());
+                    ATOMIC_FLAG_UNLOCK(flag);
+                    trusted = true;
+                    attempt = 0;
+                }
+                continue;
+            }
+            trusted = false;
+            if(stack.empty()){
+                return;
+            }
+            last = stack.back();
+            stack.pop_back();
+            func(last->value);
+            attempt = 0;
+            descend(last->right.load());
+        }
+    }
+
+    // Height of the tree, 0 for an empty tree
+    int height() {
+        ATOMIC_FLAG_LOCK(flag);
+        int h = heightOf(root.load());
+        ATOMIC_FLAG_UNLOCK(flag);
+        return h;
+    }
+
+
+private:
+
+
+    bool find(const T& value) const {
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr){
+            if(value == current->value){
+                return true;
+            }
+            current = value < current->value ? current->left.load() : current->right.load();
+        }
+        return false;
+    }
+
+    // True when no remove moved a successor since moves read version
+    bool unmoved(std::uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (version & 1) == 0 && moves.load(std::memory_order_relaxed) == version;
+    }
+
+
+    static int heightOf(const std::shared_ptr<Node>& node){
+        return node == nullptr ? 0 : node->height;
+    }
+
+    static void updateHeight(const std::shared_ptr<Node>& node){
+        node->height = 1 + std::max(heightOf(node->left.load()), heightOf(node->right.load()));
+    }
+
+    static int balanceOf(const std::shared_ptr<Node>& node){
+        return heightOf(node->left.load()) - heightOf(node->right.load());
+    }
+
+
+    void replaceChild(const std::shared_ptr<Node>& parent, const std::shared_ptr<Node>& child, std::shared_ptr<Node> desired){
+        if(parent == nullptr){
+            root.store(desired);
+        }else if(parent->left.load() == child){
+            parent->left.store(desired);
+        }else{
+            parent->right.store(desired);
+        }
+    }
+
+
+    /*
+        Rotations never relink an existing node, the two rotated nodes are rebuilt so a reader holding
+        the old ones still sees their old (complete) subtrees.
+    */
+    static std::shared_ptr<Node> rotateRight(const std::shared_ptr<Node>& y){
+
+        std::shared_ptr<Node> x = y->left.load();
+
+        std::shared_ptr<Node> newY = std::make_shared<Node>(y->value);
+        newY->left.store(x->right.load());
+        newY->right.store(y->right.load());
+        updateHeight(newY);
+
+        std::shared_ptr<Node> newX = std::make_shared<Node>(x->value);
+        newX->left.store(x->left.load());
+        newX->right.store(newY);
+        updateHeight(newX);
+
+        return newX;
+    }
+
+    static std::shared_ptr<Node> rotateLeft(const std::shared_ptr<Node>& x){
+
+        std::shared_ptr<Node> y = x->right.load();
+
+        std::shared_ptr<Node> newX = std::make_shared<Node>(x->value);
+        newX->left.store(x->left.load());
+        newX->right.store(y->left.load());
+        updateHeight(newX);
+
+        std::shared_ptr<Node> newY = std::make_shared<Node>(y->value);
+        newY->left.store(newX);
+        newY->right.store(y->right.load());
+        updateHeight(newY);
+
+        return newY;
+    }
+
+
+    // Walks the recorded path bottom-up fixing heights and rotating unbalanced nodes
+    void rebalance(const std::vector<std::shared_ptr<Node>>& path){
+
+        for(int i = static_cast<int>(path.size()) - 1; i >= 0; --i){
+
+            std::shared_ptr<Node> node = path[i];
+            updateHeight(node);
+            int balance = balanceOf(node);
+
+            std::shared_ptr<Node> result;
+            if(balance > 1){
+                if(balanceOf(node->left.load()) < 0){
+                    node->left.store(rotateLeft(node->left.load()));
+                }
+                result = rotateRight(node);
+            }else if(balance < -1){
+                if(balanceOf(node->right.load()) > 0){
+                    node->right.store(rotateRight(node->right.load()));
+                }
+                result = rotateLeft(node);
+            }
+
+            if(result != nullptr){
+                replaceChild(i > 0 ? path[i - 1] : nullptr, node, result);
+            }
+        }
+    }
+
+
+    struct Node
+    {
+        T value;
+        std::atomic<std::shared_ptr<Node>> left;
+        std::atomic<std::shared_ptr<Node>> right;
+
+        // written by writers only, always under flag
+        int height = 1;
+
+        Node(const T& value) : value(value), left(nullptr), right(nullptr) {}
+    };
+
+    std::atomic<std::shared_ptr<Node>> root;
+    // mutable: a reader that keeps failing validation walks under it
+    mutable std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    // odd while a remove moves a successor, see remove
+    std::atomic<std::uint64_t> moves = 0;
+
+};
+
+} // namespace mbu
+
+#endif // !BALANCED_THREAD_SAFE_SET_HPP__
@@ -0,0 +1,570 @@
+#ifndef BLINK_TREE_SET_HPP__
+#define BLINK_TREE_SET_HPP__
+
+#include <atomic>
+#include <thread>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+
+#include "locks.hpp"
+#include "requirements.hpp"
+#include "scalable_counter.hpp"
+
+
+namespace mbu{
+
+/*
+    B-link tree (Lehman & Yao) with the ThreadSafeSet interface, for large sets where the binary tree pays a cache
+    miss per level. A node is NodeBytes (default four cache lines) holding many sorted keys, so a lookup in a
+    few million keys touches 4-5 nodes instead of 20+ single key nodes.
+
+    Every node also has a high key and a link to its right sibling. A split first moves the upper half into a new
+    right sibling and only then posts the separator to the parent, anyone who arrives at the old node with a key at
+    or above its high key just moves right. So writers hold one node latch at a time (two while moving right or
+    installing a new root) and never lock a path.
+
+    Readers take no latch at all: a node's version is odd while a writer holds it and bumped on release, a reader
+    reads the node optimistically and only trusts what it read if the version did not change meanwhile (seqlock).
+    Keys are read while they may be written, which is why T has to be trivially copyable: a torn key is thrown
+    away by the validation before it is used.
+
+    Removes only take the key out of its leaf, nodes are never merged or freed before the destructor (clear empties
+    the leaves), so a reader can never stand on freed memory and needs no Epoch guard.
+
+    For integral keys the in-node search compares a whole vector of keys at a time (GCC vector extensions, SSE2 /
+    NEON), unused key slots are padded with the largest key so the scan needs no bound check.
+*/
+template <class T, std::size_t NodeBytes = 256>
+class BLinkTreeSet
+{
+    struct Node;
+    struct Leaf;
+    struct Inner;
+
+    // raw key slots, T needs no default constructor
+    template <std::size_t N>
+    union Slots
+    {
+        Slots() {}
+        T items[N];
+    };
+
+    static constexpr bool VECTOR_KEYS = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+    static constexpr std::size_t VECTOR_BYTES = 16;
+    static constexpr std::size_t LANES = VECTOR_KEYS ? VECTOR_BYTES / sizeof(T) : 1;
+
+    struct Header
+    {
+        std::atomic<std::uint64_t> version;
+        std::atomic<Node*> right;
+        std::atomic<int> count;
+        int level;
+        std::atomic<bool> bounded;
+        Slots<1> highKey;
+    };
+
+    // capacities are rounded down to whole vectors
+    static constexpr std::size_t LEAF_CAPACITY = (NodeBytes - sizeof(Header)) / sizeof(T) / LANES * LANES;
+    static constexpr std::size_t INNER_CAPACITY = (NodeBytes - sizeof(Header) - sizeof(Node*)) / (sizeof(T) + sizeof(Node*)) / LANES * LANES;
+
+    static_assert(LEAF_CAPACITY >= 4 && INNER_CAPACITY >= 4, "NodeBytes too small for four keys per node");
+    static_assert(!VECTOR_KEYS || LEAF_CAPACITY / LANES < 128, "NodeBytes too large for the per lane key counts");
+
+    // a tree of fan-out 2 and INT_MAX keys is 31 levels high
+    static constexpr int MAX_LEVELS = 32;
+    static constexpr int SPIN_LIMIT = 64;
+
+public:
+
+    BLinkTreeSet(){
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable, readers copy keys without a latch");
+        static_assert(has_less_than<T>, "T must have operator<");
+        static_assert(has_equal_to<T>, "T must have operator==");
+        root.store(new Leaf());
+    }
+    ~BLinkTreeSet(){
+        // every node is on its level's sibling chain, the leftmost node of a level is the first child of the one above
+        Node* leftmost = root.load();
+        while(leftmost != nullptr){
+            Node* below = leftmost->level > 0 ? static_cast<Inner*>(leftmost)->children[0].load() : nullptr;
+            for(Node* node = leftmost; node != nullptr; ){
+                Node* next = node->right.load();
+                destroy(node);
+                node = next;
+            }
+            leftmost = below;
+        }
+    }
+
+    BLinkTreeSet(const BLinkTreeSet& other) = delete;
+    BLinkTreeSet& operator=(const BLinkTreeSet& other) = delete;
+
+
+    bool insert(const T& value){
+
+        Node* path[MAX_LEVELS] = {};
+        Leaf* leaf = static_cast<Leaf*>(lockCovering(descend(value, 0, path), value));
+
+        int count = leaf->count.load(std::memory_order_relaxed);
+        int pos = lowerBound(leaf->keys.items, LEAF_CAPACITY, count, value);
+        if(pos < count && leaf->keys.items[pos] == value){
+            leaf->unlock();
+            return false;
+        }
+        counter.add(1);
+
+        if(count < static_cast<int>(LEAF_CAPACITY)){
+            std::copy_backward(leaf->keys.items + pos, leaf->keys.items + count, leaf->keys.items + count + 1);
+            leaf->keys.items[pos] = value;
+            leaf->count.store(count + 1, std::memory_order_relaxed);
+            leaf->unlock();
+            return true;
+        }
+
+        // full: the keys with value are split between leaf and a new right sibling
+        Slots<LEAF_CAPACITY + 1> all;
+        std::copy(leaf->keys.items, leaf->keys.items + pos, all.items);
+        all.items[pos] = value;
+        std::copy(leaf->keys.items + pos, leaf->keys.items + count, all.items + pos + 1);
+
+        int half = (LEAF_CAPACITY + 1) / 2;
+        Leaf* sibling = new Leaf();
+        std::copy(all.items + half, all.items + LEAF_CAPACITY + 1, sibling->keys.items);
+        sibling->count.store(LEAF_CAPACITY + 1 - half, std::memory_order_relaxed);
+
+        std::copy(all.items, all.items + half, leaf->keys.items);
+        padKeys(leaf->keys.items, half, LEAF_CAPACITY);
+        leaf->count.store(half, std::memory_order_relaxed);
+
+        linkSibling(leaf, sibling, sibling->keys.items[0]);
+        postSeparator(leaf, sibling->keys.items[0], sibling, path);
+        return true;
+    }
+
+    bool remove(const T& value){
+
+        Leaf* leaf = static_cast<Leaf*>(lockCovering(descend(value, 0, nullptr), value));
+
+        int count = leaf->count.load(std::memory_order_relaxed);
+        int pos = lowerBound(leaf->keys.items, LEAF_CAPACITY, count, value);
+        if(pos == count || !(leaf->keys.items[pos] == value)){
+            leaf->unlock();
+            return false;
+        }
+        std::copy(leaf->keys.items + pos + 1, leaf->keys.items + count, leaf->keys.items + pos);
+        padKeys(leaf->keys.items, count - 1, count);
+        leaf->count.store(count - 1, std::memory_order_relaxed);
+        leaf->unlock();
+        counter.add(-1);
+        return true;
+    }
+
+    bool search(const T& value) const {
+
+        while(true){
+            Node* node = root.load(std::memory_order_acquire);
+            std::uint64_t version = node->stableVersion();
+
+            while(true){
+                if(beyond(node, value)){
+                    Node* right = node->right.load(std::memory_order_acquire);
+                    if(!node->unchanged(version)){
+                        break;
+                    }
+                    node = right;
+                    version = node->stableVersion();
+                    continue;
+                }
+
+                if(node->level == 0){
+                    const Leaf* leaf = static_cast<const Leaf*>(node);
+                    int count = clamp(leaf->count.load(std::memory_order_relaxed), LEAF_CAPACITY);
+                    int pos = lowerBound(leaf->keys.items, LEAF_CAPACITY, count, value);
+                    bool found = pos < count && leaf->keys.items[pos] == value;
+                    if(node->unchanged(version)){
+                        return found;
+                    }
+                    break;
+                }
+
+                const Inner* inner = static_cast<const Inner*>(node);
+                Node* child = inner->children[childIndex(inner, value)].load(std::memory_order_acquire);
+                if(!node->unchanged(version)){
+                    break;
+                }
+                node = child;
+                version = node->stableVersion();
+            }
+        }
+    }
+
+    int size() const {
+        return static_cast<int>(counter.exact());
+    }
+
+    int approximate_size() const {
+        return static_cast<int>(counter.approximate());
+    }
+
+    bool empty() const {
+        return counter.exact() == 0;
+    }
+
+    // Empties the leaves one by one, the nodes stay allocated until the set is destroyed
+    void clear() {
+        for(Node* node = leftmostLeaf(); node != nullptr; ){
+            node->lock();
+            Leaf* leaf = static_cast<Leaf*>(node);
+            int count = leaf->count.load(std::memory_order_relaxed);
+            padKeys(leaf->keys.items, 0, count);
+            leaf->count.store(0, std::memory_order_relaxed);
+            Node* next = node->right.load(std::memory_order_relaxed);
+            node->unlock();
+            counter.add(-count);
+            node = next;
+        }
+    }
+
+    // Ascending, every leaf is copied out consistently (validated) before func sees its keys
+    void iterate(const std::function<void(const T&)>& func) const {
+        Slots<LEAF_CAPACITY> keys;
+        for(Node* node = leftmostLeaf(); node != nullptr; ){
+            std::uint64_t version = node->stableVersion();
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            int count = clamp(leaf->count.load(std::memory_order_relaxed), LEAF_CAPACITY);
+            std::memcpy(static_cast<void*>(keys.items), leaf->keys.items, count * sizeof(T));
+            Node* next = node->right.load(std::memory_order_acquire);
+            if(!node->unchanged(version)){
+                continue;
+            }
+            for(int i = 0; i < count; ++i){
+                func(keys.items[i]);
+            }
+            node = next;
+        }
+    }
+
+    // Levels above the leaves, 0 for a single leaf
+    int height() const {
+        return root.load()->level;
+    }
+
+
+private:
+
+    struct Node : Header
+    {
+        explicit Node(int level){
+            this->version.store(0, std::memory_order_relaxed);
+            this->right.store(nullptr, std::memory_order_relaxed);
+            this->count.store(0, std::memory_order_relaxed);
+            this->level = level;
+            this->bounded.store(false, std::memory_order_relaxed);
+        }
+
+        const T& high() const {
+            return this->highKey.items[0];
+        }
+
+        void lock(){
+            int spins = 0;
+            while(true){
+                std::uint64_t current = this->version.load(std::memory_order_relaxed);
+                if(!(current & 1) && this->version.compare_exchange_weak(current, current + 1, std::memory_order_acquire)){
+                    // the node's stores stay behind the odd version for the readers
+                    std::atomic_thread_fence(std::memory_order_release);
+                    return;
+                }
+                noteSpin();
+                if(++spins < SPIN_LIMIT){
+                    cpuRelax();
+                }else{
+                    noteYield();
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void unlock(){
+            this->version.fetch_add(1, std::memory_order_release);
+        }
+
+        // An even version, the node is not being written right now
+        std::uint64_t stableVersion() const {
+            std::uint64_t current = this->version.load(std::memory_order_acquire);
+            while(current & 1){
+                cpuRelax();
+                current = this->version.load(std::memory_order_acquire);
+            }
+            return current;
+        }
+
+        // What was read since stableVersion returned version is consistent
+        bool unchanged(std::uint64_t version) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return this->version.load(std::memory_order_relaxed) == version;
+        }
+    };
+
+    struct alignas(64) Leaf : Node
+    {
+        Slots<LEAF_CAPACITY> keys;
+
+        Leaf() : Node(0) {
+            padKeys(keys.items, 0, LEAF_CAPACITY);
+        }
+    };
+
+    // children[i] holds the keys below keys[i] and not below keys[i - 1]
+    struct alignas(64) Inner : Node
+    {
+        Slots<INNER_CAPACITY> keys;
+        std::atomic<Node*> children[INNER_CAPACITY + 1];
+
+        explicit Inner(int level) : Node(level) {
+            padKeys(keys.items, 0, INNER_CAPACITY);
+            for(std::atomic<Node*>& child : children){
+                child.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+
+    static void destroy(Node* node){
+        if(node->level == 0){
+            delete static_cast<Leaf*>(node);
+        }else{
+            delete static_cast<Inner*>(node);
+        }
+    }
+
+    static int clamp(int count, std::size_t capacity){
+        return std::min(std::max(count, 0), static_cast<int>(capacity));
+    }
+
+    // The key is at or above node's high key, it lives further right
+    static bool beyond(const Node* node, const T& value){
+        return node->bounded.load(std::memory_order_relaxed) && !(value < node->high());
+    }
+
+    // Vector keys pad the unused slots with the largest key, they then never count as below a probe
+    static void padKeys(T* keys, std::size_t first, std::size_t last){
+        if constexpr (VECTOR_KEYS){
+            std::fill(keys + first, keys + last, std::numeric_limits<T>::max());
+        }
+    }
+
+
+    // Number of keys below value, the first count of the capacity slots are in use
+    static int lowerBound(const T* keys, std::size_t capacity, int count, const T& value){
+        if constexpr (VECTOR_KEYS){
+            return std::min(countBelow<false>(keys, capacity, value), count);
+        }else{
+            return static_cast<int>(std::lower_bound(keys, keys + count, value) - keys);
+        }
+    }
+
+    // Number of separators not above value, the index of the child to follow
+    static int childIndex(const Inner* inner, const T& value){
+        int count = clamp(inner->count.load(std::memory_order_relaxed), INNER_CAPACITY);
+        if constexpr (VECTOR_KEYS){
+            return std::min(countBelow<true>(inner->keys.items, INNER_CAPACITY, value), count);
+        }else{
+            return static_cast<int>(std::upper_bound(inner->keys.items, inner->keys.items + count, value) - inner->keys.items);
+        }
+    }
+
+    // Counts the keys < value (or <= value) over the whole capacity, LANES keys per compare and no branches
+    template <bool OrEqual>
+    static int countBelow(const T* keys, std::size_t capacity, const T& value){
+        typedef T Vector __attribute__((vector_size(VECTOR_BYTES)));
+        using Mask = decltype(Vector{} < Vector{});
+
+        Vector probe = Vector{} + value;
+        Mask total{};
+        for(std::size_t i = 0; i < capacity; i += LANES){
+            Vector chunk;
+            std::memcpy(&chunk, keys + i, sizeof(chunk));
+            // a true lane is all ones (-1)
+            if constexpr (OrEqual){
+                total -= chunk <= probe;
+            }else{
+                total -= chunk < probe;
+            }
+        }
+        int below = 0;
+        for(std::size_t lane = 0; lane < LANES; ++lane){
+            below += static_cast<int>(total[lane]);
+        }
+        return below;
+    }
+
+
+    /*
+        Optimistic walk from the root down to level for value, nothing is locked. path (if given) gets the node
+        passed on every level above, a split posts its separator there first.
+    */
+    Node* descend(const T& value, int level, Node** path) const {
+
+        while(true){
+            Node* node = root.load(std::memory_order_acquire);
+            std::uint64_t version = node->stableVersion();
+
+            bool restart = false;
+            while(node->level > level){
+                Node* next;
+                if(beyond(node, value)){
+                    next = node->right.load(std::memory_order_acquire);
+                }else{
+                    next = static_cast<Inner*>(node)->children[childIndex(static_cast<Inner*>(node), value)].load(std::memory_order_acquire);
+                    if(path != nullptr){
+                        path[node->level] = node;
+                    }
+                }
+                if(!node->unchanged(version)){
+                    restart = true;
+                    break;
+                }
+                node = next;
+                version = node->stableVersion();
+            }
+            if(!restart){
+                return node;
+            }
+        }
+    }
+
+    // Locks the node on node's level that covers value, moving right (hand over hand) past splits
+    static Node* lockCovering(Node* node, const T& value){
+        node->lock();
+        while(beyond(node, value)){
+            Node* right = node->right.load(std::memory_order_relaxed);
+            right->lock();
+            node->unlock();
+            node = right;
+        }
+        return node;
+    }
+
+    // The new sibling takes over node's high key and right link, node now ends at separator. node is locked.
+    static void linkSibling(Node* node, Node* sibling, const T& separator){
+        sibling->highKey.items[0] = node->high();
+        sibling->bounded.store(node->bounded.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        sibling->right.store(node->right.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        node->highKey.items[0] = separator;
+        node->bounded.store(true, std::memory_order_relaxed);
+        node->right.store(sibling, std::memory_order_release);
+    }
+
+
+    /*
+        node (locked) has just been split into node and sibling at separator. Adds the separator to the parent level,
+        splitting upwards as far as needed. A root split installs a new root while the old one is still locked,
+        nobody else can then replace root.
+    */
+    void postSeparator(Node* node, T separator, Node* sibling, Node** path){
+
+        while(true){
+            if(root.load(std::memory_order_relaxed) == node){
+                Inner* top = new Inner(node->level + 1);
+                top->keys.items[0] = separator;
+                top->children[0].store(node, std::memory_order_relaxed);
+                top->children[1].store(sibling, std::memory_order_relaxed);
+                top->count.store(1, std::memory_order_relaxed);
+                root.store(top, std::memory_order_release);
+                node->unlock();
+                return;
+            }
+
+            // the parent seen on the way down, or (the tree grew meanwhile) a fresh walk to that level
+            int level = node->level + 1;
+            Node* parent = path[level] != nullptr ? path[level] : descend(separator, level, nullptr);
+            node->unlock();
+
+            Inner* inner = static_cast<Inner*>(lockCovering(parent, separator));
+            int count = inner->count.load(std::memory_order_relaxed);
+            int pos = static_cast<int>(std::upper_bound(inner->keys.items, inner->keys.items + count, separator) - inner->keys.items);
+
+            if(count < static_cast<int>(INNER_CAPACITY)){
+                std::copy_backward(inner->keys.items + pos, inner->keys.items + count, inner->keys.items + count + 1);
+                for(int i = count; i > pos; --i){
+                    inner->children[i + 1].store(inner->children[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+                inner->keys.items[pos] = separator;
+                inner->children[pos + 1].store(sibling, std::memory_order_release);
+                inner->count.store(count + 1, std::memory_order_relaxed);
+                inner->unlock();
+                return;
+            }
+
+            // full: the middle separator moves up, the ones right of it go to a new sibling
+            Slots<INNER_CAPACITY + 1> keys;
+            Node* children[INNER_CAPACITY + 2];
+            std::copy(inner->keys.items, inner->keys.items + pos, keys.items);
+            keys.items[pos] = separator;
+            std::copy(inner->keys.items + pos, inner->keys.items + count, keys.items + pos + 1);
+            for(int i = 0, j = 0; i <= count; ++i){
+                children[j++] = inner->children[i].load(std::memory_order_relaxed);
+                if(i == pos){
+                    children[j++] = sibling;
+                }
+            }
+
+            int half = (INNER_CAPACITY + 1) / 2;
+            Inner* next = new Inner(inner->level);
+            std::copy(keys.items + half + 1, keys.items + INNER_CAPACITY + 1, next->keys.items);
+            for(int i = half + 1; i <= static_cast<int>(INNER_CAPACITY) + 1; ++i){
+                next->children[i - half - 1].store(children[i], std::memory_order_relaxed);
+            }
+            next->count.store(INNER_CAPACITY - half, std::memory_order_relaxed);
+
+            std::copy(keys.items, keys.items + half, inner->keys.items);
+            padKeys(inner->keys.items, half, INNER_CAPACITY);
+            for(int i = 0; i <= static_cast<int>(INNER_CAPACITY); ++i){
+                inner->children[i].store(i <= half ? children[i] : nullptr, std::memory_order_relaxed);
+            }
+            inner->count.store(half, std::memory_order_relaxed);
+
+            linkSibling(inner, next, keys.items[half]);
+            node = inner;
+            separator = keys.items[half];
+            sibling = next;
+        }
+    }
+
+
+    Node* leftmostLeaf() const {
+        while(true){
+            Node* node = root.load(std::memory_order_acquire);
+            std::uint64_t version = node->stableVersion();
+            bool restart = false;
+            while(node->level > 0){
+                Node* child = static_cast<Inner*>(node)->children[0].load(std::memory_order_acquire);
+                if(!node->unchanged(version)){
+                    restart = true;
+                    break;
+                }
+                node = child;
+                version = node->stableVersion();
+            }
+            if(!restart){
+                return node;
+            }
+        }
+    }
+
+
+    std::atomic<Node*> root;
+    ScalableCounter counter;
+
+};
+
+} // namespace mbu
+
+#endif // !BLINK_TREE_SET_HPP__
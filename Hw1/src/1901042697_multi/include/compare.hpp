@@ -0,0 +1,35 @@
+#ifndef COMPARE_HPP__
+#define COMPARE_HPP__
+
+#include <compare>
+
+
+#include "requirements.hpp"
+
+
+namespace mbu{
+
+/*
+    Comparators of the ordered sets. compare(key, value) returns something that compares with 0 like key <=> value,
+    so a level of a walk costs one call instead of an operator< and an operator==.
+
+    The child is still picked with order < 0 ? left : right, which compiles to a branch. A branchless pick (cmov on
+    the compare) makes the next child load wait for the compare, the predicted branch lets the core start it early;
+    on pointer linked nodes that measured 20-50% slower even for int keys.
+*/
+template <class T>
+struct ThreeWayCompare
+{
+    template <class K> requires has_three_way<K, T> || key_for<K, T>
+    constexpr auto operator()(const K& key, const T& value) const {
+        if constexpr (has_three_way<K, T>){
+            return key <=> value;
+        }else{
+            return key == value ? std::weak_ordering::equivalent : key < value ? std::weak_ordering::less : std::weak_ordering::greater;
+        }
+    }
+};
+
+} // namespace mbu
+
+#endif // !COMPARE_HPP__
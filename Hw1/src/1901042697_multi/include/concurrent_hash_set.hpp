@@ -0,0 +1,424 @@
+#ifndef CONCURRENT_HASH_SET_HPP__
+#define CONCURRENT_HASH_SET_HPP__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+
+#include "requirements.hpp"
+#include "epoch.hpp"
+
+
+namespace mbu{
+
+/*
+    Open addressing (linear probing) hash set for membership only workloads, with the ThreadSafeSet interface.
+
+    A slot is one atomic word: a pointer to the immutable entry plus the top hash bits as a tag, so most probe
+    mismatches are decided without touching the entry. insert claims an empty slot with one CAS, remove swaps the
+    entry for a tombstone with one CAS and retires the entry to Epoch, search never writes.
+
+    Resizing is online and incremental. Once a table is half used a larger one is attached as next and every
+    writer copies a chunk of slots before its own operation. A copied slot becomes MOVED, tombstones are dropped on
+    the way. The chunks do not follow probe chains, so a reader walks past MOVED slots to the end of the chain and
+    only then goes on to the next table. A writer first moves its key's probe chain so a key is never live in both
+    tables; only a writer that meets a slot in the middle of being copied waits (yields) for it.
+*/
+template <class T, class Hash = std::hash<T>>
+class ConcurrentHashSet
+{
+    struct Entry;
+    struct Table;
+
+    static constexpr std::size_t INITIAL_CAPACITY = 64;
+    static constexpr std::size_t MIGRATE_CHUNK = 64;
+
+public:
+
+    ConcurrentHashSet(){
+        static_assert(has_hash<T, Hash>, "T must be hashable by Hash");
+        static_assert(has_equal_to<T>, "T must have operator==");
+        table.store(new Table(INITIAL_CAPACITY));
+    }
+    ~ConcurrentHashSet(){
+        Table* current = table.load();
+        for(Table* t = current; t != nullptr; t = t->next.load()){
+            for(std::size_t i = 0; i < t->capacity; ++i){
+                if(Entry* entry = entryOf(t->slots[i].load())){
+                    delete entry;
+                }
+            }
+        }
+        while(current != nullptr){
+            Table* next = current->next.load();
+            delete current;
+            current = next;
+        }
+    }
+
+    ConcurrentHashSet(const ConcurrentHashSet& other) = delete;
+    ConcurrentHashSet& operator=(const ConcurrentHashSet& other) = delete;
+
+
+    bool insert(const T& value){
+
+        Epoch::Guard guard;
+        std::size_t hash = hashOf(value);
+        Entry* entry = nullptr;
+
+        while(true){
+            Table* t = writable(hash);
+            if(t->used.load() * 2 > t->capacity){
+                grow(t);
+                continue;
+            }
+
+            std::size_t mask = t->capacity - 1;
+            std::size_t i = hash & mask;
+            bool moving = false;
+            for(std::size_t probes = 0; probes < t->capacity; ){
+
+                std::uintptr_t word = t->slots[i].load(std::memory_order_acquire);
+                if(word == EMPTY){
+                    if(entry == nullptr){
+                        entry = new Entry{hash, value};
+                    }
+                    if(t->slots[i].compare_exchange_strong(word, pack(entry))){
+                        t->used.fetch_add(1);
+                        count.fetch_add(1);
+                        return true;
+                    }
+                    continue;   // lost the slot, look at what won it
+                }
+                if(isMoving(word)){
+                    moving = true;
+                    break;
+                }
+                if(matches(word, hash, value)){
+                    delete entry;
+                    return false;
+                }
+                i = (i + 1) & mask;
+                ++probes;
+            }
+            // a moving table is left to writable, a full one grows
+            if(!moving){
+                grow(t);
+            }
+        }
+    }
+
+    bool remove(const T& value){
+
+        Epoch::Guard guard;
+        std::size_t hash = hashOf(value);
+
+        while(true){
+            Table* t = writable(hash);
+
+            std::size_t mask = t->capacity - 1;
+            std::size_t i = hash & mask;
+            bool moving = false;
+            for(std::size_t probes = 0; probes < t->capacity; ){
+
+                std::uintptr_t word = t->slots[i].load(std::memory_order_acquire);
+                if(word == EMPTY){
+                    return false;
+                }
+                if(isMoving(word)){
+                    moving = true;
+                    break;
+                }
+                if(matches(word, hash, value)){
+                    if(t->slots[i].compare_exchange_strong(word, TOMBSTONE)){
+                        count.fetch_sub(1);
+                        Epoch::retire(entryOf(word));
+                        return true;
+                    }
+                    continue;
+                }
+                i = (i + 1) & mask;
+                ++probes;
+            }
+            if(!moving){
+                return false;
+            }
+        }
+    }
+
+    bool search(const T& value) const {
+
+        Epoch::Guard guard;
+        std::size_t hash = hashOf(value);
+
+        for(Table* t = table.load(std::memory_order_acquire); t != nullptr; t = t->next.load(std::memory_order_acquire)){
+
+            std::size_t mask = t->capacity - 1;
+            std::size_t i = hash & mask;
+            // a later slot of the chain may not be copied yet, the key is only known to be gone at the chain's end
+            bool moved = false;
+            for(std::size_t probes = 0; probes < t->capacity; ++probes, i = (i + 1) & mask){
+
+                std::uintptr_t word = t->slots[i].load(std::memory_order_acquire);
+                if(word == EMPTY){
+                    break;
+                }
+                if(word == MOVED_EMPTY){
+                    moved = true;
+                    break;
+                }
+                if(word == MOVED){
+                    moved = true;
+                    continue;
+                }
+                // an entry being copied is still the live one
+                if(matches(word, hash, value)){
+                    return true;
+                }
+            }
+            if(!moved){
+                return false;
+            }
+        }
+        return false;
+    }
+
+    int size() const {
+        return count.load();
+    }
+
+    bool empty() const {
+        return count.load() == 0;
+    }
+
+    void clear() {
+        Epoch::Guard guard;
+        iterate([this](const T& value){ remove(value); });
+    }
+
+    // Unordered. Finishes a running resize first, a resize started during the walk may repeat or skip the keys it moves
+    void iterate(const std::function<void(const T&)>& func) {
+
+        Epoch::Guard guard;
+        Table* t = table.load();
+        if(t->next.load() != nullptr){
+            finishMigration(t);
+            t = table.load();
+        }
+        for(std::size_t i = 0; i < t->capacity; ++i){
+            if(Entry* entry = entryOf(t->slots[i].load(std::memory_order_acquire))){
+                func(entry->value);
+            }
+        }
+    }
+
+    std::size_t capacity() const {
+        return table.load()->capacity;
+    }
+
+
+private:
+
+    /*
+        Slot words. Entries are at least 8 byte aligned and user space pointers fit in 57 bits,
+        the low bits are free for the sentinels and the copying flag, the top 7 bits hold the tag.
+    */
+    static constexpr std::uintptr_t EMPTY = 0;
+    static constexpr std::uintptr_t COPYING = 1;
+    static constexpr std::uintptr_t TOMBSTONE = 2;
+    static constexpr std::uintptr_t MOVED = 4;
+    static constexpr std::uintptr_t MOVED_EMPTY = 6;
+
+    static constexpr int TAG_SHIFT = 57;
+    static constexpr std::uintptr_t TAG_MASK = ~std::uintptr_t(0) << TAG_SHIFT;
+    static constexpr std::uintptr_t POINTER_MASK = ~TAG_MASK & ~std::uintptr_t(7);
+
+    static_assert(sizeof(std::uintptr_t) == 8, "ConcurrentHashSet packs tags into 64 bit pointers");
+
+
+    static std::size_t hashOf(const T& value){
+        // std::hash is the identity for integers, mix it so both the index and the tag bits are spread
+        std::uint64_t h = Hash()(value);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static std::uintptr_t pack(Entry* entry){
+        return reinterpret_cast<std::uintptr_t>(entry) | (entry->hash & TAG_MASK);
+    }
+
+    static Entry* entryOf(std::uintptr_t word){
+        return reinterpret_cast<Entry*>(word & POINTER_MASK);
+    }
+
+    static bool isMoving(std::uintptr_t word){
+        return word == MOVED || word == MOVED_EMPTY || (word & COPYING);
+    }
+
+    static bool matches(std::uintptr_t word, std::size_t hash, const T& value){
+        if((word & POINTER_MASK) == 0 || (word & TAG_MASK) != (hash & TAG_MASK)){
+            return false;
+        }
+        Entry* entry = entryOf(word);
+        return entry->hash == hash && entry->value == value;
+    }
+
+
+    // The table a writer of hash works on, during a resize that is the next one after hash's chain has been moved
+    Table* writable(std::size_t hash){
+        Table* t = table.load();
+        Table* next = t->next.load();
+        if(next == nullptr){
+            return t;
+        }
+        migrateChunk(t);
+        migrateChain(t, hash);
+        return next;
+    }
+
+
+    // Attaches a bigger table to the current one, a table that is itself still being filled first finishes its predecessor
+    void grow(Table* t){
+        Table* current = table.load();
+        if(current != t || current->next.load() != nullptr){
+            finishMigration(current);
+            return;
+        }
+
+        std::size_t capacity = static_cast<std::size_t>(count.load()) * 4 > current->capacity ? current->capacity * 2 : current->capacity;
+        Table* next = new Table(capacity);
+        Table* expected = nullptr;
+        if(!current->next.compare_exchange_strong(expected, next)){
+            delete next;
+        }
+    }
+
+
+    void finishMigration(Table* t){
+        if(t->next.load() == nullptr){
+            return;
+        }
+        while(t->migrateIndex.load() < t->capacity){
+            migrateChunk(t);
+        }
+        while(table.load() == t){
+            std::this_thread::yield();
+        }
+    }
+
+
+    void migrateChunk(Table* t){
+        std::size_t begin = t->migrateIndex.fetch_add(MIGRATE_CHUNK);
+        for(std::size_t i = begin; i < begin + MIGRATE_CHUNK && i < t->capacity; ++i){
+            migrateSlot(t, i);
+        }
+    }
+
+
+    // Moves every slot of hash's probe chain, up to and including the first empty one
+    void migrateChain(Table* t, std::size_t hash){
+        std::size_t mask = t->capacity - 1;
+        std::size_t i = hash & mask;
+        for(std::size_t probes = 0; probes < t->capacity; ++probes, i = (i + 1) & mask){
+            if(migrateSlot(t, i) == MOVED_EMPTY){
+                return;
+            }
+        }
+    }
+
+
+    // Returns the final word of the slot, MOVED or MOVED_EMPTY
+    std::uintptr_t migrateSlot(Table* t, std::size_t i){
+        std::atomic<std::uintptr_t>& slot = t->slots[i];
+        while(true){
+            std::uintptr_t word = slot.load();
+            if(word == MOVED || word == MOVED_EMPTY){
+                return word;
+            }
+            if(word & COPYING){
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::uintptr_t moved = word == EMPTY ? MOVED_EMPTY : MOVED;
+            if(word == EMPTY || word == TOMBSTONE){
+                if(slot.compare_exchange_strong(word, moved)){
+                    slotMoved(t);
+                    return moved;
+                }
+                continue;
+            }
+
+            // Only the thread that sets COPYING copies the entry, so it lands in the next table exactly once
+            if(slot.compare_exchange_strong(word, word | COPYING)){
+                place(t->next.load(), entryOf(word));
+                slot.store(MOVED);
+                slotMoved(t);
+                return MOVED;
+            }
+        }
+    }
+
+
+    void place(Table* t, Entry* entry){
+        std::size_t mask = t->capacity - 1;
+        std::size_t i = entry->hash & mask;
+        while(true){
+            std::uintptr_t word = EMPTY;
+            if(t->slots[i].compare_exchange_strong(word, pack(entry))){
+                t->used.fetch_add(1);
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+
+    // The thread that moves the last slot publishes the next table and retires the old one
+    void slotMoved(Table* t){
+        if(t->migrated.fetch_add(1) + 1 == t->capacity){
+            Table* expected = t;
+            table.compare_exchange_strong(expected, t->next.load());
+            Epoch::retire(t);
+        }
+    }
+
+
+    struct Entry
+    {
+        std::size_t hash;
+        T value;
+    };
+
+    struct Table
+    {
+        std::size_t capacity;
+        std::unique_ptr<std::atomic<std::uintptr_t>[]> slots;
+        std::atomic<std::size_t> used = 0;
+
+        std::atomic<Table*> next = nullptr;
+        std::atomic<std::size_t> migrateIndex = 0;
+        std::atomic<std::size_t> migrated = 0;
+
+        explicit Table(std::size_t capacity) : capacity(capacity), slots(new std::atomic<std::uintptr_t>[capacity]) {
+            for(std::size_t i = 0; i < capacity; ++i){
+                slots[i].store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::atomic<Table*> table;
+    std::atomic<int> count = 0;
+
+};
+
+} // namespace mbu
+
+#endif // !CONCURRENT_HASH_SET_HPP__
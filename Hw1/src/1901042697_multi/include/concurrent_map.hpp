@@ -0,0 +1,162 @@
+#ifndef CONCURRENT_MAP_HPP__
+#define CONCURRENT_MAP_HPP__
+
+#include <memory>
+#include <utility>
+#include <optional>
+#include <type_traits>
+
+
+#include "thread_safe_set.hpp"
+
+
+namespace mbu{
+
+/*
+    Key / value map on the ThreadSafeSet tree, so a request that needs the key's payload does one walk under one
+    synchronization instead of a set lookup plus an externally locked side map.
+
+    Every node holds an Entry: the key, the value and a small lock of its own. The tree orders entries by key and
+    its writers (flag in Global mode, node locks in Coupling mode) guard which entries exist. The entry lock only
+    guards the value, find copies it out under that lock and insert_or_assign / compute change it in place under it,
+    found by the same walk that would have inserted the key. Entries are never copied (they hold a lock), a remove
+    relinks the successor's node instead, so a value can not be lost to a stale copy.
+*/
+template <class K, class V, class Alloc = std::allocator<std::pair<const K, V>>, class Lock = SpinLock, class Compare = ThreeWayCompare<K>>
+class ConcurrentMap
+{
+    // compute on a missing key: the value is value initialized and passed through fn before the entry is linked
+    struct Computed {};
+
+    struct Entry
+    {
+        K key;
+        mutable V value;
+        mutable Lock lock;
+
+        template <class... Args>
+        explicit Entry(const K& key, Args&&... args) : key(key), value(std::forward<Args>(args)...) {}
+
+        template <class F>
+        Entry(Computed, const K& key, F& fn) : key(key), value() {
+            fn(value);
+        }
+
+        Entry(const Entry& other) = delete;
+        Entry& operator=(const Entry& other) = delete;
+    };
+
+    // Orders entries by key and compares any key Compare takes with an entry
+    struct EntryCompare
+    {
+        [[no_unique_address]] Compare compare;
+
+        auto operator()(const Entry& lhs, const Entry& rhs) const {
+            return compare(lhs.key, rhs.key);
+        }
+
+        template <class Q> requires std::is_invocable_v<const Compare&, const Q&, const K&>
+        auto operator()(const Q& key, const Entry& entry) const {
+            return compare(key, entry.key);
+        }
+    };
+
+    using Tree = ThreadSafeSet<Entry, Alloc, Lock, EntryCompare>;
+
+public:
+
+    ConcurrentMap(LockMode mode = LockMode::Global, const Alloc& alloc = Alloc(), const Compare& compare = Compare())
+        : tree(mode, ReadMode::Shared, alloc, EntryCompare{compare}) {}
+
+    ConcurrentMap(const ConcurrentMap& other) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap& other) = delete;
+
+
+    // Copy of the value of key, taken under the entry's lock
+    template <class Q = K> requires std::is_invocable_v<const Compare&, const Q&, const K&>
+    std::optional<V> find(const Q& key) const {
+        std::optional<V> result;
+        tree.visit(key, [&result](const Entry& entry){
+            entry.lock.lock();
+            result.emplace(entry.value);
+            entry.lock.unlock();
+        });
+        return result;
+    }
+
+    template <class Q = K> requires std::is_invocable_v<const Compare&, const Q&, const K&>
+    bool contains(const Q& key) const {
+        return tree.search(key);
+    }
+
+    // Adds key or overwrites its value, returns true when key was added
+    template <class M>
+    bool insert_or_assign(const K& key, M&& value){
+        return tree.emplace_or_visit(key, [&value](const Entry& entry){
+            entry.lock.lock();
+            entry.value = std::forward<M>(value);
+            entry.lock.unlock();
+        }, key, std::forward<M>(value));
+    }
+
+    // Adds key with V(args...) unless it is already there, the value is only built when it is added
+    template <class... Args>
+    bool try_emplace(const K& key, Args&&... args){
+        return tree.emplace_or_visit(key, [](const Entry&){}, key, std::forward<Args>(args)...);
+    }
+
+    /*
+        Calls fn(V&) on the value of key under the entry's lock, so it is atomic against every other find, compute and
+        insert_or_assign of key. A missing key is added with a value initialized V that fn has already been applied
+        to. Returns true when key was added. fn runs inside the tree's writer lock too, keep it short.
+    */
+    template <class F> requires std::is_invocable_v<F&, V&>
+    bool compute(const K& key, F&& fn){
+        return tree.emplace_or_visit(key, [&fn](const Entry& entry){
+            entry.lock.lock();
+            fn(entry.value);
+            entry.lock.unlock();
+        }, Computed{}, key, fn);
+    }
+
+    template <class Q = K> requires std::is_invocable_v<const Compare&, const Q&, const K&>
+    bool erase(const Q& key){
+        return tree.remove(key);
+    }
+
+    int size() const {
+        return tree.size();
+    }
+
+    bool empty() const {
+        return tree.empty();
+    }
+
+    void clear() {
+        tree.clear();
+    }
+
+    // f(key, value) in key order, every value is read under its entry's lock
+    template <class F>
+    void iterate(F&& f) const {
+        tree.iterate([&f](const Entry& entry){
+            entry.lock.lock();
+            f(entry.key, static_cast<const V&>(entry.value));
+            entry.lock.unlock();
+        });
+    }
+
+    LockMode lockMode() const {
+        return tree.lockMode();
+    }
+
+
+private:
+
+    Tree tree;
+
+};
+
+} // namespace mbu
+
+#endif // !CONCURRENT_MAP_HPP__
@@ -0,0 +1,296 @@
+#ifndef CONCURRENT_SKIP_LIST_SET_HPP__
+#define CONCURRENT_SKIP_LIST_SET_HPP__
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <cstdint>
+#include <functional>
+
+
+#include "requirements.hpp"
+#include "epoch.hpp"
+
+
+namespace mbu{
+
+/*
+    Lock-free skip list (Herlihy & Shavit) with the ThreadSafeSet interface.
+
+    Every level is a linked list updated only by CAS on the next pointers. The lowest bit of a next pointer
+    marks its owner as logically removed, marked nodes are snipped out by the next writer passing them.
+    Level 0 holds every key in order so iterate needs no rebalancing or locking.
+
+    Every operation pins the epoch, a removed node is retired to Epoch once it is snipped out of every level and
+    freed after the readers that might still be standing on it have left.
+*/
+template <class T>
+class ConcurrentSkipListSet
+{
+    struct Node;
+
+    static constexpr int MAX_LEVEL = 24;
+
+public:
+
+    ConcurrentSkipListSet(){
+        static_assert(has_less_than<T>, "T must have operator<");
+        static_assert(has_equal_to<T>, "T must have operator==");
+        for(auto& link : head){
+            link.store(nullptr);
+        }
+    }
+    ~ConcurrentSkipListSet(){
+        Node* current = head[0].load();
+        while(current != nullptr){
+            Node* next = unmarked(current->next[0].load());
+            delete current;
+            current = next;
+        }
+    }
+
+    ConcurrentSkipListSet(const ConcurrentSkipListSet& other) = delete;
+    ConcurrentSkipListSet& operator=(const ConcurrentSkipListSet& other) = delete;
+
+
+    bool insert(const T& value){
+
+        Epoch::Guard guard;
+        int topLevel = randomLevel();
+        std::atomic<Node*>* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+
+        while(true){
+            if(find(value, preds, succs)){
+                return false;
+            }
+
+            Node* node = new Node(value, topLevel);
+            for(int level = 0; level < topLevel; ++level){
+                node->next[level].store(succs[level], std::memory_order_relaxed);
+            }
+
+            Node* expected = succs[0];
+            if(!preds[0][0].compare_exchange_strong(expected, node)){
+                delete node;
+                continue;
+            }
+
+            // The key is in the set now, the upper levels are only shortcuts
+            linkUpper(node, preds, succs);
+            if(isMarked(node->next[0].load())){
+                // removed while its levels were linked, a remover's find may have run before the last one
+                find(value, preds, succs);
+            }
+            release(node);
+            return true;
+        }
+    }
+
+    bool remove(const T& value){
+
+        Epoch::Guard guard;
+        std::atomic<Node*>* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+
+        if(!find(value, preds, succs)){
+            return false;
+        }
+
+        Node* victim = succs[0];
+        for(int level = victim->topLevel - 1; level > 0; --level){
+            Node* succ = victim->next[level].load();
+            while(!isMarked(succ) && !victim->next[level].compare_exchange_weak(succ, marked(succ))){
+            }
+        }
+
+        // Whoever marks level 0 owns the removal
+        Node* succ = victim->next[0].load();
+        while(true){
+            if(isMarked(succ)){
+                return false;
+            }
+            if(victim->next[0].compare_exchange_weak(succ, marked(succ))){
+                find(value, preds, succs);
+                release(victim);
+                return true;
+            }
+        }
+    }
+
+    bool search(const T& value) const {
+
+        Epoch::Guard guard;
+        const std::atomic<Node*>* pred = head;
+        Node* current = nullptr;
+        for(int level = MAX_LEVEL - 1; level >= 0; --level){
+            current = unmarked(pred[level].load());
+            while(current != nullptr){
+                Node* succ = current->next[level].load();
+                while(isMarked(succ)){
+                    current = unmarked(succ);
+                    if(current == nullptr){
+                        break;
+                    }
+                    succ = current->next[level].load();
+                }
+                if(current == nullptr || !(current->value < value)){
+                    break;
+                }
+                pred = current->next.get();
+                current = unmarked(succ);
+            }
+        }
+        return current != nullptr && current->value == value;
+    }
+
+    int size() const {
+        int count = 0;
+        iterate([&count](const T&){ ++count; });
+        return count;
+    }
+
+    bool empty() const {
+        Epoch::Guard guard;
+        for(Node* current = head[0].load(); current != nullptr; current = unmarked(current->next[0].load())){
+            if(!isMarked(current->next[0].load())){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void clear() {
+        Epoch::Guard guard;
+        for(Node* current = head[0].load(); current != nullptr; current = unmarked(head[0].load())){
+            remove(current->value);
+        }
+    }
+
+    void iterate(const std::function<void(const T&)>& func) const {
+        Epoch::Guard guard;
+        for(Node* current = head[0].load(); current != nullptr; ){
+            Node* next = current->next[0].load();
+            if(!isMarked(next)){
+                func(current->value);
+            }
+            current = unmarked(next);
+        }
+    }
+
+
+private:
+
+
+    static bool isMarked(Node* node){
+        return reinterpret_cast<std::uintptr_t>(node) & 1;
+    }
+
+    static Node* marked(Node* node){
+        return reinterpret_cast<Node*>(reinterpret_cast<std::uintptr_t>(node) | 1);
+    }
+
+    static Node* unmarked(Node* node){
+        return reinterpret_cast<Node*>(reinterpret_cast<std::uintptr_t>(node) & ~std::uintptr_t(1));
+    }
+
+
+    static int randomLevel(){
+        thread_local std::mt19937 eng(std::random_device{}());
+        std::uint32_t bits = eng();
+        int level = 1;
+        while((bits & 1) && level < MAX_LEVEL){
+            ++level;
+            bits >>= 1;
+        }
+        return level;
+    }
+
+
+    /*
+        Fills preds (the next array of the predecessor) and succs for every level and snips the marked
+        nodes on the way. Returns true if value is at succs[0].
+    */
+    bool find(const T& value, std::atomic<Node*>** preds, Node** succs){
+
+    retry:
+        std::atomic<Node*>* pred = head;
+        for(int level = MAX_LEVEL - 1; level >= 0; --level){
+            Node* current = unmarked(pred[level].load());
+            while(current != nullptr){
+                Node* succ = current->next[level].load();
+                while(isMarked(succ)){
+                    Node* expected = current;
+                    if(!pred[level].compare_exchange_strong(expected, unmarked(succ))){
+                        goto retry;
+                    }
+                    current = unmarked(succ);
+                    if(current == nullptr){
+                        break;
+                    }
+                    succ = current->next[level].load();
+                }
+                if(current == nullptr || !(current->value < value)){
+                    break;
+                }
+                pred = current->next.get();
+                current = unmarked(succ);
+            }
+            preds[level] = pred;
+            succs[level] = current;
+        }
+        return succs[0] != nullptr && succs[0]->value == value;
+    }
+
+
+    // Links levels 1 .. topLevel - 1 of node, stops early once node is marked
+    void linkUpper(Node* node, std::atomic<Node*>** preds, Node** succs){
+        for(int level = 1; level < node->topLevel; ++level){
+            while(true){
+                Node* nodeNext = node->next[level].load();
+                if(isMarked(nodeNext)){
+                    return;
+                }
+                if(nodeNext != succs[level] && !node->next[level].compare_exchange_strong(nodeNext, succs[level])){
+                    continue;
+                }
+                Node* expected = succs[level];
+                if(preds[level][level].compare_exchange_strong(expected, node)){
+                    break;
+                }
+                find(node->value, preds, succs);
+            }
+        }
+    }
+
+
+    /*
+        The inserter (once its levels are linked) and the remover (once its find snipped the node) each drop one
+        owner, the last one retires the node. Both ran a find after the node was last linked and marked, so it is
+        out of every level by then and no reader pinned later can reach it.
+    */
+    void release(Node* node){
+        if(node->owners.fetch_sub(1) == 1){
+            Epoch::retire(node);
+        }
+    }
+
+
+    struct Node
+    {
+        T value;
+        int topLevel;
+        std::unique_ptr<std::atomic<Node*>[]> next;
+        // the inserter and the remover, see release
+        std::atomic<int> owners = 2;
+
+        Node(const T& value, int topLevel) : value(value), topLevel(topLevel), next(new std::atomic<Node*>[topLevel]) {}
+    };
+
+    std::atomic<Node*> head[MAX_LEVEL];
+
+};
+
+} // namespace mbu
+
+#endif // !CONCURRENT_SKIP_LIST_SET_HPP__
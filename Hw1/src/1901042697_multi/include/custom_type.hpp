@@ -2,6 +2,8 @@
 #define CUSTOM_TYPE_HPP__
 
 #include <iostream>
+#include <functional>
+#include <compare>
 
 class CustomType{
 public:
@@ -12,10 +14,34 @@ public:
 
     bool operator<(const CustomType& other)  const;
 
+    // Plain int keys, a set of CustomType can be probed without building one
+    bool operator==(int key) const;
+    bool operator<(int key) const;
+    friend bool operator<(int key, const CustomType& obj){
+        return key < obj.x;
+    }
+
+    // Inline three way compare, the sets order by it with one comparison per node
+    std::strong_ordering operator<=>(const CustomType& other) const {
+        return x <=> other.x;
+    }
+
+    std::strong_ordering operator<=>(int key) const {
+        return x <=> key;
+    }
+
     friend std::ostream& operator<<(std::ostream& os, const CustomType& obj){
         os << obj.x;
         return os;
     }
 };
 
+template<>
+struct std::hash<CustomType>
+{
+    std::size_t operator()(const CustomType& obj) const noexcept {
+        return std::hash<int>()(obj.x);
+    }
+};
+
 #endif // !CUSTOM_TYPE_HPP__
\ No newline at end of file
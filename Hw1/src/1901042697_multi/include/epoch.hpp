@@ -0,0 +1,46 @@
+#ifndef EPOCH_HPP__
+#define EPOCH_HPP__
+
+#include <cstdint>
+
+
+namespace mbu{
+
+/*
+    Epoch based memory reclamation for raw pointer data structures.
+
+    A thread pins the current global epoch with a Guard before it loads any shared pointer and unpins when the
+    Guard is destroyed. An unlinked node is handed to retire() instead of delete, it is freed only after the
+    global epoch moved two steps ahead, at that point no pinned thread can still be holding it.
+    Retired pointers are kept per thread so retire never takes a lock.
+*/
+class Epoch
+{
+public:
+
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+    };
+
+    template <class T>
+    static void retire(T* ptr){
+        retire(ptr, [](void* p){ delete static_cast<T*>(p); });
+    }
+
+    static void retire(void* ptr, void (*deleter)(void*));
+
+    // Tries to advance the global epoch and frees the calling thread's pointers whose grace period is over
+    static void collect();
+
+    static std::uint64_t current();
+};
+
+} // namespace mbu
+
+#endif // !EPOCH_HPP__
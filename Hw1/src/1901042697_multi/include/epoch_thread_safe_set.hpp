@@ -0,0 +1,388 @@
+#ifndef EPOCH_THREAD_SAFE_SET_HPP__
+#define EPOCH_THREAD_SAFE_SET_HPP__
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+
+#include "macros.hpp"
+#include "locks.hpp"
+#include "requirements.hpp"
+#include "epoch.hpp"
+
+
+namespace mbu{
+
+/*
+    ThreadSafeSet with raw pointer links and epoch based reclamation.
+
+    Readers only pin the epoch and follow atomic raw pointers, there is no reference count and no hidden lock
+    on the read path. Writers use the same hand-over-hand locking as LockMode::Coupling, unlinked nodes are
+    retired to Epoch and freed once no reader can reach them.
+    Like ThreadSafeSet's optimistic readers they are validated against moves, see unlink.
+*/
+template <class T>
+class EpochThreadSafeSet
+{
+    struct Node;
+
+    // validated attempts before a reader walks with the writers held off
+    static constexpr int READ_RETRIES = 8;
+    // moves: (version << 16) | writers inside unlink
+    static constexpr std::uint64_t VERSION_STEP = 1 << 16;
+    static constexpr std::uint64_t ACTIVE_MASK = VERSION_STEP - 1;
+
+public:
+
+    EpochThreadSafeSet(){
+        static_assert(has_less_than<T>, "T must have operator<");
+        static_assert(has_equal_to<T>, "T must have operator==");
+    }
+    ~EpochThreadSafeSet(){
+        destroy(root.load());
+    }
+
+    EpochThreadSafeSet(const EpochThreadSafeSet& other) = delete;
+    EpochThreadSafeSet& operator=(const EpochThreadSafeSet& other) = delete;
+
+    EpochThreadSafeSet(EpochThreadSafeSet&& other){
+        root.store(other.root.load());
+        other.root.store(nullptr);
+    };
+
+    EpochThreadSafeSet& operator=(EpochThreadSafeSet&& other){
+        destroy(root.load());
+        root.store(other.root.load());
+        other.root.store(nullptr);
+        return *this;
+    };
+
+
+    bool insert(const T& value){
+
+        Epoch::Guard guard;
+        ATOMIC_FLAG_LOCK(flag);
+        Node* current = root.load();
+        if(current == nullptr){
+            root.store(new Node(value));
+            ATOMIC_FLAG_UNLOCK(flag);
+            return true;
+        }
+        current->wait_lock();
+        writers.fetch_add(1);
+        ATOMIC_FLAG_UNLOCK(flag);
+
+        bool added = false;
+        while(true){
+            if(value == current->value){
+                break;
+            }
+
+            std::atomic<Node*>& link = value < current->value ? current->left : current->right;
+            Node* next = link.load();
+            if(next == nullptr){
+                link.store(new Node(value));
+                added = true;
+                break;
+            }
+
+            next->wait_lock();
+            current->unlock();
+            current = next;
+        }
+
+        current->unlock();
+        writers.fetch_sub(1);
+        return added;
+    }
+
+    bool remove(const T& value){
+
+        Epoch::Guard guard;
+        ATOMIC_FLAG_LOCK(flag);
+        Node* current = root.load();
+        if(current == nullptr){
+            ATOMIC_FLAG_UNLOCK(flag);
+            return false;
+        }
+        current->wait_lock();
+        writers.fetch_add(1);
+
+        // parent == nullptr means the link is root and it is guarded by flag
+        Node* parent = nullptr;
+        std::atomic<Node*>* link = &root;
+
+        while(!(value == current->value)){
+
+            std::atomic<Node*>& nextLink = value < current->value ? current->left : current->right;
+            Node* next = nextLink.load();
+            if(next == nullptr){
+                current->unlock();
+                release(parent);
+                writers.fetch_sub(1);
+                return false;
+            }
+
+            next->wait_lock();
+            release(parent);
+            parent = current;
+            link = &nextLink;
+            current = next;
+        }
+
+        unlink(*link, current);
+        current->unlock();
+        release(parent);
+        writers.fetch_sub(1);
+
+        Epoch::retire(current);
+        return true;
+    }
+
+    // A hit is taken as it is, only a miss is validated against moves
+    bool search(const T& value) const {
+
+        Epoch::Guard guard;
+        for(int attempt = 0; attempt < READ_RETRIES; ++attempt){
+            std::uint64_t version = moves.load(std::memory_order_acquire);
+            if(find(value)){
+                return true;
+            }
+            if(unmoved(version)){
+                return false;
+            }
+            cpuRelax();
+        }
+        lockWriters();
+        bool found = find(value);
+        ATOMIC_FLAG_UNLOCK(flag);
+        return found;
+    }
+
+    int size() const {
+        int count = 0;
+        iterate([&count](const T&){ ++count; });
+        return count;
+    }
+
+    bool empty() const {
+        return root.load() == nullptr;
+    }
+
+    // Waits for the writers inside the tree to leave, then retires the detached tree node by node
+    void clear() {
+        Epoch::Guard guard;
+        lockWriters();
+        Node* detached = root.exchange(nullptr);
+        ATOMIC_FLAG_UNLOCK(flag);
+
+        forEachNode(detached, [](Node* node){ Epoch::retire(node); });
+    }
+
+    /*
+        In order walk with an explicit stack. moves is checked before every key, when a successor moved meanwhile
+        the stack is rebuilt from the root for the keys above the last one reported; after READ_RETRIES rebuilds in
+        a row one is done with the writers held off (func is not called then). A key that stays in the set is
+        reported exactly once. The epoch stays pinned, so the last reported node is still there to resume from.
+    */
+    void iterate(const std::function<void(const T&)>& func) const {
+
+        Epoch::Guard guard;
+        std::vector<Node*> stack;
+        Node* last = nullptr;
+        auto descend = [&](Node* current){
+            while(current != nullptr){
+                if(last != nullptr && !(last->value < current->value)){
+                    current = current->right.load(std::memory_order_acquire);
+                }else{
+                    stack.push_back(current);
+                    current = current->left.load(std::memory_order_acquire);
+                }
+            }
+        };
+
+        std::uint64_t version = moves.load(std::memory_order_acquire);
+        descend(root.load(std::memory_order_acquire));
+        int attempt = 0;
+        bool trusted = false;
+        while(true){
+            if(!trusted && !unmoved(version)){
+                stack.clear();
+                if(++attempt < READ_RETRIES){
+                    cpuRelax();
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load(std::memory_order_acquire));
+                }else{
+                    lockWriters();
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load(std::memory_order_acquire));
+                    ATOMIC_FLAG_UNLOCK(flag);
+                    trusted = true;
+                    attempt = 0;
+                }
+                continue;
+            }
+            trusted = false;
+            if(stack.empty()){
+                return;
+            }
+            last = stack.back();
+            stack.pop_back();
+            func(last->value);
+            attempt = 0;
+            descend(last->right.load(std::memory_order_acquire));
+        }
+    }
+
+
+private:
+
+
+    // Both the owner of link and current must be locked by the caller, current is retired by the caller
+    void unlink(std::atomic<Node*>& link, Node* current){
+
+        Node* left = current->left.load();
+        Node* right = current->right.load();
+
+        if(left == nullptr){
+            link.store(right);
+            return;
+        }
+        if(right == nullptr){
+            link.store(left);
+            return;
+        }
+
+        Node* sParent = current;
+        Node* successor = right;
+        successor->wait_lock();
+        for(Node* next = successor->left.load(); next != nullptr; next = successor->left.load()){
+            next->wait_lock();
+            if(sParent != current){
+                sParent->unlock();
+            }
+            sParent = successor;
+            successor = next;
+        }
+
+        /*
+            The replacement is published before the successor is detached. A reader that passed current before
+            the swap and is still on its way down to the successor misses its key once sParent lets go of it,
+            and iterate can meet the key twice; the moves window around this sends them back.
+        */
+        moves.fetch_add(1);
+        Node* replacement = new Node(successor->value);
+        replacement->left.store(left);
+        replacement->right.store(right);
+        link.store(replacement, std::memory_order_release);
+
+        if(sParent == current){
+            replacement->right.store(successor->right.load());
+        }else{
+            sParent->left.store(successor->right.load());
+            sParent->unlock();
+        }
+        moves.fetch_add(VERSION_STEP - 1);
+        successor->unlock();
+
+        Epoch::retire(successor);
+    }
+
+
+    // Unvalidated walk, the caller pins the epoch
+    bool find(const T& value) const {
+        Node* current = root.load(std::memory_order_acquire);
+        while(current != nullptr){
+            if(value == current->value){
+                return true;
+            }
+            current = value < current->value ? current->left.load(std::memory_order_acquire)
+                                             : current->right.load(std::memory_order_acquire);
+        }
+        return false;
+    }
+
+    // True when no successor move ran since moves read version
+    bool unmoved(std::uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (version & ACTIVE_MASK) == 0 && moves.load(std::memory_order_relaxed) == version;
+    }
+
+    // Takes flag and waits for the writers inside the tree to leave, no writer runs until flag is released
+    void lockWriters() const {
+        ATOMIC_FLAG_LOCK(flag);
+        while(writers.load() != 0){
+            std::this_thread::yield();
+        }
+    }
+
+
+    void release(Node* parent){
+        if(parent != nullptr){
+            parent->unlock();
+        }else{
+            ATOMIC_FLAG_UNLOCK(flag);
+        }
+    }
+
+
+    template <class F>
+    static void forEachNode(Node* top, F f){
+        std::vector<Node*> stack;
+        if(top != nullptr){
+            stack.push_back(top);
+        }
+        while(!stack.empty()){
+            Node* node = stack.back();
+            stack.pop_back();
+            if(Node* left = node->left.load()){
+                stack.push_back(left);
+            }
+            if(Node* right = node->right.load()){
+                stack.push_back(right);
+            }
+            f(node);
+        }
+    }
+
+    static void destroy(Node* top){
+        forEachNode(top, [](Node* node){ delete node; });
+    }
+
+
+    struct Node
+    {
+        T value;
+        std::atomic<Node*> left;
+        std::atomic<Node*> right;
+
+        std::atomic_flag marked = ATOMIC_FLAG_INIT;
+
+
+        Node(const T& value) : value(value), left(nullptr), right(nullptr) {}
+
+        void wait_lock(){
+            ATOMIC_FLAG_LOCK(marked);
+        }
+
+        void unlock(){
+            ATOMIC_FLAG_UNLOCK(marked);
+        }
+
+    };
+
+    std::atomic<Node*> root = nullptr;
+    // mutable: a reader that keeps failing validation walks under it
+    mutable std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    // writers that released flag but still hold node locks, clear and the reader fallback wait for them
+    std::atomic<int> writers = 0;
+    std::atomic<std::uint64_t> moves = 0;
+
+};
+
+} // namespace mbu
+
+#endif // !EPOCH_THREAD_SAFE_SET_HPP__
@@ -0,0 +1,182 @@
+#ifndef FROZEN_SET_HPP__
+#define FROZEN_SET_HPP__
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+
+#include "compare.hpp"
+
+
+namespace mbu{
+
+/*
+    Immutable sorted set for long read only phases, see ThreadSafeSet::freeze. It never changes after construction,
+    so any number of threads read it without any synchronization.
+
+    The keys live in one array in Eytzinger (BFS) order: keys[1] is the root and the children of keys[k] are
+    keys[2k] and keys[2k + 1], there are no pointers and no per node allocations. A lookup walks
+    k = 2k + (key > keys[k]) without a branch, the next index only depends on arithmetic. The 16 (for 4 byte keys)
+    descendants four levels below k are keys[16k .. 16k + 15], one cache line, and are prefetched while the
+    current level is compared, so the memory latency of the deep levels overlaps with the walk.
+
+    Compares stay scalar: every level depends on the one above it, there is nothing to put in a vector register
+    along one lookup (BLinkTreeSet compares whole nodes of keys at a time instead).
+*/
+template <class T, class Compare = ThreeWayCompare<T>>
+class FrozenSet
+{
+    // descendants of one index that share a cache line, prefetched a few levels ahead
+    static constexpr std::size_t BLOCK = std::bit_floor(std::max<std::size_t>(2, 64 / sizeof(T)));
+
+public:
+
+    FrozenSet(const Compare& compare = Compare()) : compare(compare) {}
+
+    // Linear for sorted unique input (what freeze passes), anything else is sorted and deduplicated first
+    explicit FrozenSet(std::vector<T> sorted, const Compare& compare = Compare()) : compare(compare) {
+
+        auto less = [this](const T& lhs, const T& rhs){ return this->compare(lhs, rhs) < 0; };
+        auto equal = [this](const T& lhs, const T& rhs){ return this->compare(lhs, rhs) == 0; };
+        if(!std::is_sorted(sorted.begin(), sorted.end(), less)){
+            std::sort(sorted.begin(), sorted.end(), less);
+        }
+        sorted.erase(std::unique(sorted.begin(), sorted.end(), equal), sorted.end());
+        if(sorted.empty()){
+            return;
+        }
+
+        // keys[0] is never read, it only keeps the indexes 1 based
+        keys.reserve(sorted.size() + 1);
+        keys.push_back(sorted.front());
+        keys.insert(keys.end(), sorted.begin(), sorted.end());
+
+        // in order visit of the implicit tree hands out the sorted keys in ascending order
+        std::size_t rank = 0;
+        for(std::size_t k = first(); k != 0; k = next(k)){
+            keys[k] = std::move(sorted[rank++]);
+        }
+    }
+
+
+    template <class K = T> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    bool search(const K& key) const {
+        std::size_t k = lowerIndex(key);
+        return k != 0 && compare(key, keys[k]) == 0;
+    }
+
+    // Smallest key not less than key
+    template <class K = T> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    std::optional<T> lower_bound(const K& key) const {
+        std::size_t k = lowerIndex(key);
+        return k != 0 ? std::optional<T>(keys[k]) : std::nullopt;
+    }
+
+    // Smallest key greater than key
+    template <class K = T> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    std::optional<T> upper_bound(const K& key) const {
+        std::size_t k = upperIndex(key);
+        return k != 0 ? std::optional<T>(keys[k]) : std::nullopt;
+    }
+
+    int size() const {
+        return keys.empty() ? 0 : static_cast<int>(keys.size() - 1);
+    }
+
+    bool empty() const {
+        return keys.empty();
+    }
+
+    // Ascending order
+    template <class F>
+    void iterate(F&& f) const {
+        for(std::size_t k = first(); k != 0; k = next(k)){
+            f(keys[k]);
+        }
+    }
+
+    // Calls f with every key in [lo, hi) in ascending order
+    template <class F>
+    void range_for_each(const T& lo, const T& hi, F&& f) const {
+        for(std::size_t k = lowerIndex(lo); k != 0 && compare(keys[k], hi) < 0; k = next(k)){
+            f(keys[k]);
+        }
+    }
+
+    int count_range(const T& lo, const T& hi) const {
+        int count = 0;
+        range_for_each(lo, hi, [&count](const T&){ ++count; });
+        return count;
+    }
+
+
+private:
+
+    /*
+        Index of the first key not less (lowerIndex) / greater (upperIndex) than key, 0 if there is none.
+        The walk falls off the bottom at k = (answer << (r + 1)) | (2^r - 1), r the number of right turns taken
+        after the answer, so shifting out the trailing ones and one more bit gives the answer back.
+    */
+    template <class K>
+    std::size_t lowerIndex(const K& key) const {
+        std::size_t n = keys.size();
+        std::size_t k = 1;
+        while(k < n){
+            prefetch(k * BLOCK);
+            k = 2 * k + (compare(key, keys[k]) > 0);
+        }
+        return k >> std::countr_one(k) >> 1;
+    }
+
+    template <class K>
+    std::size_t upperIndex(const K& key) const {
+        std::size_t n = keys.size();
+        std::size_t k = 1;
+        while(k < n){
+            prefetch(k * BLOCK);
+            k = 2 * k + (compare(key, keys[k]) >= 0);
+        }
+        return k >> std::countr_one(k) >> 1;
+    }
+
+    // Only a hint, an index past the end is never dereferenced
+    void prefetch(std::size_t k) const {
+        __builtin_prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(keys.data()) + k * sizeof(T)));
+    }
+
+    // Leftmost index of the implicit tree, 0 when empty
+    std::size_t first() const {
+        std::size_t k = 0;
+        for(std::size_t i = 1; i < keys.size(); i *= 2){
+            k = i;
+        }
+        return k;
+    }
+
+    // In order successor of k, 0 after the largest key
+    std::size_t next(std::size_t k) const {
+        if(2 * k + 1 < keys.size()){
+            k = 2 * k + 1;
+            while(2 * k < keys.size()){
+                k = 2 * k;
+            }
+            return k;
+        }
+        // up while k is a right child, then once more to the parent it is the left child of
+        return k >> std::countr_one(k) >> 1;
+    }
+
+    std::vector<T> keys;
+    [[no_unique_address]] Compare compare;
+
+};
+
+} // namespace mbu
+
+#endif // !FROZEN_SET_HPP__
@@ -0,0 +1,199 @@
+#ifndef LOCKS_HPP__
+#define LOCKS_HPP__
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+
+#include "macros.hpp"
+
+
+namespace mbu{
+
+/*
+    Lock policies for ThreadSafeSet, each one is a plain lock() / unlock() pair.
+    They differ in what a waiting thread does and in which order the waiters get the lock.
+*/
+
+
+// Tells the core it is in a spin loop: frees pipeline resources for the sibling hyper-thread and saves power
+inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+
+// Test-and-set that yields after 58 failed tries, the ATOMIC_FLAG_LOCK spin the sets always used. Unfair.
+class SpinLock
+{
+public:
+
+    void lock(){
+        ATOMIC_FLAG_LOCK(flag);
+    }
+
+    void unlock(){
+        ATOMIC_FLAG_UNLOCK(flag);
+    }
+
+private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+
+/*
+    Test-and-test-and-set with exponential backoff. Waiters spin on a plain load, so the line stays shared until
+    the lock is released, and back off longer after every lost exchange. Past MAX_BACKOFF they yield the core.
+*/
+class BackoffLock
+{
+public:
+
+    static constexpr int MIN_BACKOFF = 4;
+    static constexpr int MAX_BACKOFF = 1024;
+
+    void lock(){
+        int backoff = MIN_BACKOFF;
+        while(true){
+            while(locked.load(std::memory_order_relaxed)){
+                noteSpin();
+                cpuRelax();
+            }
+            if(!locked.exchange(true, std::memory_order_acquire)){
+                return;
+            }
+            noteSpin();
+            if(backoff < MAX_BACKOFF){
+                for(int i = 0; i < backoff; ++i){
+                    cpuRelax();
+                }
+                backoff *= 2;
+            }else{
+                noteYield();
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock(){
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked = false;
+};
+
+
+/*
+    FIFO ticket lock: a waiter takes the next ticket and waits until it is served.
+    Strictly fair, which also means a preempted waiter holds up everyone behind it, so waiters yield after a while.
+*/
+class TicketLock
+{
+public:
+
+    static constexpr int SPIN_LIMIT = 64;
+
+    void lock(){
+        std::uint32_t ticket = next.fetch_add(1, std::memory_order_relaxed);
+        int spins = 0;
+        while(serving.load(std::memory_order_acquire) != ticket){
+            noteSpin();
+            if(++spins < SPIN_LIMIT){
+                cpuRelax();
+            }else{
+                noteYield();
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock(){
+        serving.store(serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<std::uint32_t> next = 0;
+    std::atomic<std::uint32_t> serving = 0;
+};
+
+
+/*
+    MCS queue lock: every waiter spins on a flag in its own queue node and the holder hands the lock to its
+    successor directly, so a release touches one waiter's cache line instead of all of them. FIFO.
+    Queue nodes come from a per-thread pool, a thread may hold any number of McsLocks at once.
+*/
+class McsLock
+{
+public:
+
+    struct QNode
+    {
+        std::atomic<QNode*> next = nullptr;
+        std::atomic<bool> locked = false;
+        QNode* free = nullptr;
+    };
+
+    static constexpr int SPIN_LIMIT = 64;
+
+    void lock();
+    void unlock();
+
+private:
+
+    static QNode* acquireNode();
+    static void releaseNode(QNode* node);
+
+    std::atomic<QNode*> tail = nullptr;
+    // written only by the holder, after it got the lock
+    QNode* owner = nullptr;
+};
+
+
+/*
+    Blocking lock on C++20 atomic wait / notify (a futex on Linux), state 0 free, 1 locked, 2 locked with sleepers.
+    After a short spin a waiter sleeps in the kernel instead of burning its core, unlock only makes a system call
+    when someone is asleep.
+*/
+class BlockingLock
+{
+public:
+
+    static constexpr int SPIN_LIMIT = 64;
+
+    void lock(){
+        int expected = 0;
+        if(state.compare_exchange_strong(expected, 1, std::memory_order_acquire)){
+            return;
+        }
+        for(int i = 0; i < SPIN_LIMIT; ++i){
+            noteSpin();
+            cpuRelax();
+            expected = 0;
+            if(state.load(std::memory_order_relaxed) == 0 && state.compare_exchange_strong(expected, 1, std::memory_order_acquire)){
+                return;
+            }
+        }
+        while(state.exchange(2, std::memory_order_acquire) != 0){
+            noteYield();
+            state.wait(2, std::memory_order_relaxed);
+        }
+    }
+
+    void unlock(){
+        if(state.exchange(0, std::memory_order_release) == 2){
+            state.notify_one();
+        }
+    }
+
+private:
+    std::atomic<int> state = 0;
+};
+
+} // namespace mbu
+
+#endif // !LOCKS_HPP__
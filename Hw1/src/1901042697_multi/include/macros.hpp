@@ -4,6 +4,8 @@
 #include <atomic>
 #include <thread>
 
+#include "stats.hpp"
+
 
 #define COMPARE_EXCHANGE_WEAK(ptr, expected, desired) \
     while(true){\
@@ -23,7 +25,9 @@
 #define ATOMIC_FLAG_LOCK(lock) \
     int c = 0;\
     while(lock.test_and_set(std::memory_order_acquire)){\
+        ::mbu::noteSpin();\
         if(c++ >= 58){\
+            ::mbu::noteYield();\
             std::this_thread::yield();\
         }\
     }\
@@ -32,7 +36,9 @@
     lock.clear(std::memory_order_release);\
 
 #define ATOMIC_BOOL_LOCK(lock)\
-    while(lock.exchange(true)){}\
+    while(lock.exchange(true)){\
+        ::mbu::noteSpin();\
+    }\
 
 #define ATOMIC_BOOL_UNLOCK(lock)\
     lock.store(false);\
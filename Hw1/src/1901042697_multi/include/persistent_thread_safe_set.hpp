@@ -0,0 +1,267 @@
+#ifndef PERSISTENT_THREAD_SAFE_SET_HPP__
+#define PERSISTENT_THREAD_SAFE_SET_HPP__
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+
+#include "requirements.hpp"
+
+
+namespace mbu{
+
+/*
+    Copy-on-write (path copying) AVL tree with the ThreadSafeSet interface.
+
+    Nodes are immutable once built. A writer copies only the O(log n) nodes on its root-to-leaf path, the rest of
+    the tree is shared with the previous version, and publishes the new root with a single CAS. There is no set
+    wide flag, a writer that loses the CAS rebuilds its path on top of the winner's root.
+    Every root is a complete version of the set so snapshot() is O(1) and stays valid for as long as it is held.
+*/
+template <class T>
+class PersistentThreadSafeSet
+{
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+public:
+
+    // Immutable view of the set at the moment snapshot() was called
+    class Snapshot
+    {
+    public:
+
+        bool search(const T& value) const {
+            const Node* current = root.get();
+            while(current != nullptr){
+                if(value == current->value){
+                    return true;
+                }
+                current = value < current->value ? current->left.get() : current->right.get();
+            }
+            return false;
+        }
+
+        int size() const {
+            int count = 0;
+            iterate([&count](const T&){ ++count; });
+            return count;
+        }
+
+        bool empty() const {
+            return root == nullptr;
+        }
+
+        void iterate(const std::function<void(const T&)>& func) const {
+            std::vector<const Node*> stack;
+            const Node* current = root.get();
+            while(current != nullptr || !stack.empty()){
+                while(current != nullptr){
+                    stack.push_back(current);
+                    current = current->left.get();
+                }
+                current = stack.back();
+                stack.pop_back();
+                func(current->value);
+                current = current->right.get();
+            }
+        }
+
+    private:
+        friend class PersistentThreadSafeSet;
+
+        explicit Snapshot(NodePtr root) : root(std::move(root)) {}
+
+        NodePtr root;
+    };
+
+
+    PersistentThreadSafeSet(){
+        static_assert(has_less_than<T>, "T must have operator<");
+        static_assert(has_equal_to<T>, "T must have operator==");
+    }
+    ~PersistentThreadSafeSet(){
+        clear();
+    }
+
+    PersistentThreadSafeSet(const PersistentThreadSafeSet& other) = delete;
+    PersistentThreadSafeSet& operator=(const PersistentThreadSafeSet& other) = delete;
+
+    PersistentThreadSafeSet(PersistentThreadSafeSet&& other){
+        root.store(other.root.load());
+        other.root.store(nullptr);
+    };
+
+    PersistentThreadSafeSet& operator=(PersistentThreadSafeSet&& other){
+        root.store(other.root.load());
+        other.root.store(nullptr);
+        return *this;
+    };
+
+
+    bool insert(const T& value){
+
+        NodePtr expected = root.load();
+        while(true){
+            bool added = false;
+            NodePtr desired = insert(expected, value, added);
+            if(!added){
+                return false;
+            }
+            if(root.compare_exchange_weak(expected, desired)){
+                return true;
+            }
+        }
+    }
+
+    bool remove(const T& value){
+
+        NodePtr expected = root.load();
+        while(true){
+            bool removed = false;
+            NodePtr desired = remove(expected, value, removed);
+            if(!removed){
+                return false;
+            }
+            if(root.compare_exchange_weak(expected, desired)){
+                return true;
+            }
+        }
+    }
+
+    bool search(const T& value) const {
+        return snapshot().search(value);
+    }
+
+    int size() const {
+        return snapshot().size();
+    }
+
+    bool empty() const {
+        return root.load() == nullptr;
+    }
+
+    void clear() {
+        root.store(nullptr);
+    }
+
+    void iterate(const std::function<void(const T&)>& func) const {
+        snapshot().iterate(func);
+    }
+
+    Snapshot snapshot() const {
+        return Snapshot(root.load());
+    }
+
+
+private:
+
+
+    static int heightOf(const NodePtr& node){
+        return node == nullptr ? 0 : node->height;
+    }
+
+    static NodePtr make(const T& value, NodePtr left, NodePtr right){
+        return std::make_shared<const Node>(value, std::move(left), std::move(right));
+    }
+
+    // Builds value with the given subtrees, rotating if their heights differ by more than one
+    static NodePtr balance(const T& value, NodePtr left, NodePtr right){
+
+        int hl = heightOf(left);
+        int hr = heightOf(right);
+
+        if(hl > hr + 1){
+            if(heightOf(left->left) >= heightOf(left->right)){
+                return make(left->value, left->left, make(value, left->right, std::move(right)));
+            }
+            return make(left->right->value, make(left->value, left->left, left->right->left),
+                                            make(value, left->right->right, std::move(right)));
+        }
+        if(hr > hl + 1){
+            if(heightOf(right->right) >= heightOf(right->left)){
+                return make(right->value, make(value, std::move(left), right->left), right->right);
+            }
+            return make(right->left->value, make(value, std::move(left), right->left->left),
+                                            make(right->value, right->left->right, right->right));
+        }
+        return make(value, std::move(left), std::move(right));
+    }
+
+
+    static NodePtr insert(const NodePtr& node, const T& value, bool& added){
+
+        if(node == nullptr){
+            added = true;
+            return make(value, nullptr, nullptr);
+        }
+        if(value == node->value){
+            return node;
+        }
+        if(value < node->value){
+            NodePtr left = insert(node->left, value, added);
+            return added ? balance(node->value, std::move(left), node->right) : node;
+        }
+        NodePtr right = insert(node->right, value, added);
+        return added ? balance(node->value, node->left, std::move(right)) : node;
+    }
+
+
+    static NodePtr removeMin(const NodePtr& node){
+        if(node->left == nullptr){
+            return node->right;
+        }
+        return balance(node->value, removeMin(node->left), node->right);
+    }
+
+
+    static NodePtr remove(const NodePtr& node, const T& value, bool& removed){
+
+        if(node == nullptr){
+            return node;
+        }
+        if(value == node->value){
+            removed = true;
+            if(node->left == nullptr){
+                return node->right;
+            }
+            if(node->right == nullptr){
+                return node->left;
+            }
+            const Node* successor = node->right.get();
+            while(successor->left != nullptr){
+                successor = successor->left.get();
+            }
+            return balance(successor->value, node->left, removeMin(node->right));
+        }
+        if(value < node->value){
+            NodePtr left = remove(node->left, value, removed);
+            return removed ? balance(node->value, std::move(left), node->right) : node;
+        }
+        NodePtr right = remove(node->right, value, removed);
+        return removed ? balance(node->value, node->left, std::move(right)) : node;
+    }
+
+
+    struct Node
+    {
+        const T value;
+        const NodePtr left;
+        const NodePtr right;
+        const int height;
+
+        Node(const T& value, NodePtr left, NodePtr right)
+            : value(value), left(std::move(left)), right(std::move(right))
+            , height(1 + std::max(heightOf(this->left), heightOf(this->right))) {}
+    };
+
+    std::atomic<NodePtr> root;
+
+};
+
+} // namespace mbu
+
+#endif // !PERSISTENT_THREAD_SAFE_SET_HPP__
@@ -3,7 +3,9 @@
 
 #include <type_traits>
 #include <concepts>
+#include <compare>
 #include <iostream>
+#include <functional>
 
 template<class L, class R = L>
 concept has_less_than = requires(const L& lhs, const R& rhs)
@@ -17,6 +19,22 @@ concept has_equal_to = requires(const L& lhs, const R& rhs)
     {lhs == rhs} -> std::same_as<bool>;
 };
 
+template<class L, class R = L>
+concept has_three_way = requires(const L& lhs, const R& rhs)
+{
+    {lhs <=> rhs};
+};
+
+// A key K that can probe a set of T without being converted to T
+template<class K, class T>
+concept key_for = has_less_than<K, T> && has_equal_to<K, T>;
+
+template<class L, class H = std::hash<L>>
+concept has_hash = requires(const L& lhs)
+{
+    {H()(lhs)} -> std::convertible_to<std::size_t>;
+};
+
 template<class L>
 concept has_cout = requires(const L& lhs)
 {
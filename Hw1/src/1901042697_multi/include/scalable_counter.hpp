@@ -0,0 +1,55 @@
+#ifndef SCALABLE_COUNTER_HPP__
+#define SCALABLE_COUNTER_HPP__
+
+#include <atomic>
+
+
+namespace mbu{
+
+/*
+    Striped ("sloppy") counter for element counts that are written on every insert/remove.
+
+    A thread adds to its own cache line sized stripe, so writers on different cores do not bounce one counter
+    line between them. A stripe whose value reaches SYNC_THRESHOLD folds it into the global total.
+    exact() sums every stripe and the total, approximate() only reads the total: every stripe may hold up to
+    SYNC_THRESHOLD - 1 unfolded in either direction, so it can be off by up to STRIPES * SYNC_THRESHOLD (1024)
+    both ways. Neither is ever negative: a read racing the writers can land below zero (removals not folded yet,
+    or a fold counted twice) and is clamped to 0. Both are exact once the writers are done.
+*/
+class ScalableCounter
+{
+public:
+
+    static constexpr int STRIPES = 16;
+    static constexpr long SYNC_THRESHOLD = 64;
+
+    ScalableCounter() = default;
+
+    ScalableCounter(const ScalableCounter& other) = delete;
+    ScalableCounter& operator=(const ScalableCounter& other) = delete;
+
+    void add(long delta);
+
+    long exact() const;
+    long approximate() const;
+
+    // Not atomic with respect to add, the caller keeps the writers out
+    void reset(long value = 0);
+
+private:
+
+    static int stripeIndex();
+
+    struct alignas(64) Stripe
+    {
+        std::atomic<long> value = 0;
+    };
+
+    Stripe stripes[STRIPES];
+    alignas(64) std::atomic<long> total = 0;
+
+};
+
+} // namespace mbu
+
+#endif // !SCALABLE_COUNTER_HPP__
@@ -0,0 +1,150 @@
+#ifndef SHARDED_THREAD_SAFE_SET_HPP__
+#define SHARDED_THREAD_SAFE_SET_HPP__
+
+#include <array>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+
+
+#include "thread_safe_set.hpp"
+
+
+namespace mbu{
+
+// Routes a key to hash(key) % shards, iterate visits the shards in order so the keys come out unordered
+template <class T, class Hash = std::hash<T>>
+struct HashPartition
+{
+    static constexpr bool ordered = false;
+
+    std::size_t operator()(const T& value, std::size_t shards) const {
+        return Hash()(value) % shards;
+    }
+};
+
+// Shard i holds the keys in [bounds[i-1], bounds[i]), iterate visits the shards in order so the keys come out sorted
+template <class T, std::size_t N>
+struct RangePartition
+{
+    static constexpr bool ordered = true;
+
+    std::array<T, N - 1> bounds;
+
+    explicit RangePartition(const std::array<T, N - 1>& bounds) : bounds(bounds) {}
+
+    std::size_t operator()(const T& value, std::size_t) const {
+        return std::upper_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    }
+};
+
+
+/*
+    N independent ThreadSafeSet shards, each with its own flag, so writers of different shards never meet.
+    Every shard sits on its own cache line so neighbouring locks do not false-share.
+*/
+template <class T, std::size_t N, class Partition = HashPartition<T>, class Alloc = std::allocator<T>, class Lock = SpinLock>
+class ShardedThreadSafeSet
+{
+    static_assert(N > 0, "ShardedThreadSafeSet needs at least one shard");
+
+    struct alignas(64) Shard
+    {
+        ThreadSafeSet<T, Alloc, Lock> set;
+    };
+
+public:
+
+    ShardedThreadSafeSet(const Partition& partition = Partition(), LockMode mode = LockMode::Global) : partition(partition) {
+        for(Shard& shard : shards){
+            shard.set = ThreadSafeSet<T, Alloc, Lock>(mode);
+        }
+    }
+
+    ShardedThreadSafeSet(const ShardedThreadSafeSet& other) = delete;
+    ShardedThreadSafeSet& operator=(const ShardedThreadSafeSet& other) = delete;
+
+
+    bool insert(const T& value){
+        return shardOf(value).insert(value);
+    }
+
+    // value is only read to pick the shard before it is moved
+    bool insert(T&& value){
+        ThreadSafeSet<T, Alloc, Lock>& shard = shardOf(value);
+        return shard.insert(std::move(value));
+    }
+
+    bool remove(const T& value){
+        return shardOf(value).remove(value);
+    }
+
+    bool search(const T& value) const {
+        return shardOf(value).search(value);
+    }
+
+    int size() const {
+        int count = 0;
+        for(const Shard& shard : shards){
+            count += shard.set.size();
+        }
+        return count;
+    }
+
+    int approximate_size() const {
+        int count = 0;
+        for(const Shard& shard : shards){
+            count += shard.set.approximate_size();
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return std::all_of(shards.begin(), shards.end(), [](const Shard& shard){ return shard.set.empty(); });
+    }
+
+    void clear() {
+        for(Shard& shard : shards){
+            shard.set.clear();
+        }
+    }
+
+    // Sorted for an ordered Partition, every shard is still a separate (per shard consistent) walk
+    void iterate(const std::function<void(const T&)>& func) {
+        for(Shard& shard : shards){
+            shard.set.iterate(func);
+        }
+    }
+
+    // Sum over the shards
+    SetStats stats() const {
+        SetStats total;
+        for(const Shard& shard : shards){
+            total += shard.set.stats();
+        }
+        return total;
+    }
+
+    static constexpr std::size_t shardCount(){
+        return N;
+    }
+
+
+private:
+
+    ThreadSafeSet<T, Alloc, Lock>& shardOf(const T& value){
+        return shards[partition(value, N)].set;
+    }
+
+    const ThreadSafeSet<T, Alloc, Lock>& shardOf(const T& value) const {
+        return shards[partition(value, N)].set;
+    }
+
+    std::array<Shard, N> shards;
+    Partition partition;
+
+};
+
+} // namespace mbu
+
+#endif // !SHARDED_THREAD_SAFE_SET_HPP__
@@ -0,0 +1,88 @@
+#ifndef SLAB_ALLOCATOR_HPP__
+#define SLAB_ALLOCATOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+
+namespace mbu{
+
+struct SlabStats
+{
+    std::uint64_t allocations = 0;     // blocks handed out by the pool
+    std::uint64_t deallocations = 0;   // blocks given back to the pool
+    std::uint64_t slabs = 0;           // system allocations made by the pool, one per SLAB_SIZE bytes
+};
+
+/*
+    Per-thread slab pool for small fixed size blocks (tree nodes and their control blocks).
+
+    Every thread keeps its own free list for each size class, so allocate and deallocate touch no shared state.
+    Blocks are carved from SLAB_SIZE slabs, a freed block goes to the freeing thread's list and is reused there.
+    When a thread caches too many blocks, calls release() or exits, its free lists are moved to a shared depot
+    in one batch per size class where other threads refill from. Slabs are never returned to the system.
+*/
+class SlabPool
+{
+public:
+
+    static constexpr std::size_t ALIGNMENT = 16;
+    static constexpr std::size_t MAX_BLOCK = 256;
+    static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+
+    static void* allocate(std::size_t size);
+    static void deallocate(void* ptr, std::size_t size) noexcept;
+
+    // Bulk release: hands every block cached by the calling thread to the depot
+    static void release();
+
+    static SlabStats stats();
+
+    static constexpr bool fits(std::size_t size, std::size_t alignment){
+        return size <= MAX_BLOCK && alignment <= ALIGNMENT;
+    }
+};
+
+
+// Standard allocator over SlabPool, single objects come from the pool and arrays from operator new
+template <class T>
+class SlabAllocator
+{
+public:
+
+    using value_type = T;
+
+    SlabAllocator() noexcept = default;
+
+    template <class U>
+    SlabAllocator(const SlabAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n){
+        if(n == 1 && SlabPool::fits(sizeof(T), alignof(T))){
+            return static_cast<T*>(SlabPool::allocate(sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept {
+        if(n == 1 && SlabPool::fits(sizeof(T), alignof(T))){
+            SlabPool::deallocate(ptr, sizeof(T));
+        }else{
+            ::operator delete(ptr);
+        }
+    }
+
+    static void release(){
+        SlabPool::release();
+    }
+
+    template <class U>
+    bool operator==(const SlabAllocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+} // namespace mbu
+
+#endif // !SLAB_ALLOCATOR_HPP__
@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_FILE_HPP__
+#define SNAPSHOT_FILE_HPP__
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace mbu{
+
+/*
+    Binary snapshot of a sorted key array, see ThreadSafeSet::save / load.
+
+    A 32 byte header followed by the raw keys in ascending order, native byte order and layout, so only trivially
+    copyable keys can be stored and the file is read back by the build it was written for. The header carries the
+    format version, the key size and count and a checksum of the key bytes; anything that does not match is
+    rejected on load. The file is written next to path and renamed over it, a crash never leaves half a snapshot.
+*/
+struct SnapshotHeader
+{
+    static constexpr char MAGIC[8] = {'M', 'B', 'U', 'S', 'E', 'T', '\r', '\n'};
+    static constexpr std::uint32_t VERSION = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t keySize;
+    std::uint64_t count;
+    std::uint64_t checksum;
+};
+
+static_assert(sizeof(SnapshotHeader) == 32, "the snapshot header is part of the file format");
+
+
+// 64 bit hash of the key bytes, one multiply per 8 bytes
+std::uint64_t snapshotChecksum(const void* data, std::size_t bytes);
+
+// Throws std::system_error when the file can not be written
+void writeSnapshot(const std::string& path, const void* keys, std::uint64_t count, std::uint32_t keySize);
+
+
+/*
+    Read only mmap of a snapshot file, validated on open. The keys stay mapped (no copy, no parsing) until the
+    object is destroyed. Throws std::system_error when the file can not be mapped and std::runtime_error when it
+    is not a valid snapshot of keySize byte keys.
+*/
+class MappedSnapshot
+{
+public:
+
+    MappedSnapshot(const std::string& path, std::uint32_t keySize);
+    ~MappedSnapshot();
+
+    MappedSnapshot(const MappedSnapshot& other) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot& other) = delete;
+
+    const void* keys() const {
+        return static_cast<const char*>(data) + sizeof(SnapshotHeader);
+    }
+
+    std::uint64_t count() const {
+        return keyCount;
+    }
+
+private:
+    void* data = nullptr;
+    std::size_t bytes = 0;
+    std::uint64_t keyCount = 0;
+};
+
+} // namespace mbu
+
+#endif // !SNAPSHOT_FILE_HPP__
@@ -0,0 +1,276 @@
+#ifndef STATS_HPP__
+#define STATS_HPP__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+/*
+    Instrumentation for the sets, compiled in only with -DMBU_SET_STATS (make stats).
+    Without it every hook below is an empty inline function, StatsRecorder and StatsScope are empty
+    and stats() returns a zeroed snapshot, so a normal build pays nothing.
+*/
+
+namespace mbu{
+
+// Snapshot of a log2 histogram, bucket i counts the samples in [2^(i-1), 2^i), bucket 0 the zeros
+struct Histogram
+{
+    static constexpr int BUCKETS = 40;
+
+    std::array<std::uint64_t, BUCKETS> buckets{};
+
+    std::uint64_t count() const {
+        std::uint64_t total = 0;
+        for(std::uint64_t n : buckets){
+            total += n;
+        }
+        return total;
+    }
+
+    // Upper bound of the bucket holding the q quantile (0 < q <= 1)
+    std::uint64_t percentile(double q) const {
+        double rank = q * count();
+        std::uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; ++i){
+            seen += buckets[i];
+            if(seen != 0 && seen >= rank){
+                return i == 0 ? 0 : std::uint64_t(1) << i;
+            }
+        }
+        return 0;
+    }
+
+    Histogram& operator+=(const Histogram& other){
+        for(int i = 0; i < BUCKETS; ++i){
+            buckets[i] += other.buckets[i];
+        }
+        return *this;
+    }
+};
+
+
+enum class SetOp { Insert, Remove, Search, Bulk, COUNT };
+
+// Everything recorded for one set, times in nanoseconds
+struct SetStats
+{
+    static constexpr int OPS = static_cast<int>(SetOp::COUNT);
+
+    std::array<std::uint64_t, OPS> ops{};     // completed operations per SetOp
+    std::array<Histogram, OPS> latency;       // duration per SetOp
+    Histogram depth;                          // nodes visited by insert / remove / search
+    Histogram lockWait;                       // time to get the set wide lock
+    Histogram lockHold;                       // time the set wide lock was held
+
+    std::uint64_t spins = 0;                  // failed lock attempts, node locks included
+    std::uint64_t yields = 0;                 // std::this_thread::yield calls
+    std::uint64_t readRetries = 0;            // lock-free reads sent back by a successor move
+    std::uint64_t readFallbacks = 0;          // reads that gave up, optimistic to shared walk, shared to walk under flag
+
+    std::uint64_t count(SetOp op) const {
+        return ops[static_cast<int>(op)];
+    }
+
+    const Histogram& latencyOf(SetOp op) const {
+        return latency[static_cast<int>(op)];
+    }
+
+    SetStats& operator+=(const SetStats& other){
+        for(int i = 0; i < OPS; ++i){
+            ops[i] += other.ops[i];
+            latency[i] += other.latency[i];
+        }
+        depth += other.depth;
+        lockWait += other.lockWait;
+        lockHold += other.lockHold;
+        spins += other.spins;
+        yields += other.yields;
+        readRetries += other.readRetries;
+        readFallbacks += other.readFallbacks;
+        return *this;
+    }
+};
+
+
+/*
+    Spin and yield counts of the calling thread. The lock loops bump them without knowing which set
+    they belong to, a StatsScope charges the difference over its operation to its set.
+*/
+struct SpinCounters
+{
+    std::uint64_t spins = 0;
+    std::uint64_t yields = 0;
+};
+
+#ifdef MBU_SET_STATS
+inline thread_local SpinCounters spinCounters;
+#endif
+
+inline void noteSpin(){
+#ifdef MBU_SET_STATS
+    ++spinCounters.spins;
+#endif
+}
+
+inline void noteYield(){
+#ifdef MBU_SET_STATS
+    ++spinCounters.yields;
+#endif
+}
+
+
+#ifdef MBU_SET_STATS
+
+class StatsRecorder
+{
+public:
+
+    static std::uint64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void operation(SetOp op, std::uint64_t nanoseconds, int depth, const SpinCounters& spent){
+        int i = static_cast<int>(op);
+        ops[i].fetch_add(1, std::memory_order_relaxed);
+        add(latency[i], nanoseconds);
+        if(depth >= 0){
+            add(depths, static_cast<std::uint64_t>(depth));
+        }
+        spins.fetch_add(spent.spins, std::memory_order_relaxed);
+        yields.fetch_add(spent.yields, std::memory_order_relaxed);
+    }
+
+    // Called by the new holder right after it got the lock, waitStart is now() from before lock()
+    void locked(std::uint64_t waitStart){
+        std::uint64_t time = now();
+        add(lockWait, time - waitStart);
+        holdStart = time;
+    }
+
+    // Called by the holder right before it unlocks
+    void unlocking(){
+        add(lockHold, now() - holdStart);
+    }
+
+    void readRetry(){
+        readRetries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void readFallback(){
+        readFallbacks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SetStats snapshot() const {
+        SetStats result;
+        for(int i = 0; i < SetStats::OPS; ++i){
+            result.ops[i] = ops[i].load(std::memory_order_relaxed);
+            result.latency[i] = copy(latency[i]);
+        }
+        result.depth = copy(depths);
+        result.lockWait = copy(lockWait);
+        result.lockHold = copy(lockHold);
+        result.spins = spins.load(std::memory_order_relaxed);
+        result.yields = yields.load(std::memory_order_relaxed);
+        result.readRetries = readRetries.load(std::memory_order_relaxed);
+        result.readFallbacks = readFallbacks.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+
+    using AtomicHistogram = std::array<std::atomic<std::uint64_t>, Histogram::BUCKETS>;
+
+    static void add(AtomicHistogram& histogram, std::uint64_t value){
+        int bucket = 0;
+        while(value != 0 && bucket < Histogram::BUCKETS - 1){
+            value >>= 1;
+            ++bucket;
+        }
+        histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static Histogram copy(const AtomicHistogram& histogram){
+        Histogram result;
+        for(int i = 0; i < Histogram::BUCKETS; ++i){
+            result.buckets[i] = histogram[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    std::array<std::atomic<std::uint64_t>, SetStats::OPS> ops{};
+    std::array<AtomicHistogram, SetStats::OPS> latency{};
+    AtomicHistogram depths{};
+    AtomicHistogram lockWait{};
+    AtomicHistogram lockHold{};
+    std::atomic<std::uint64_t> spins = 0;
+    std::atomic<std::uint64_t> yields = 0;
+    std::atomic<std::uint64_t> readRetries = 0;
+    std::atomic<std::uint64_t> readFallbacks = 0;
+
+    // written and read by the holder of the set wide lock only
+    std::uint64_t holdStart = 0;
+};
+
+
+// Times one operation and charges its spins, yields and traversal depth to the recorder
+class StatsScope
+{
+public:
+
+    StatsScope(StatsRecorder& recorder, SetOp op) : recorder(recorder), op(op), before(spinCounters), start(StatsRecorder::now()) {}
+
+    ~StatsScope(){
+        SpinCounters spent{spinCounters.spins - before.spins, spinCounters.yields - before.yields};
+        recorder.operation(op, StatsRecorder::now() - start, depth, spent);
+    }
+
+    StatsScope(const StatsScope& other) = delete;
+    StatsScope& operator=(const StatsScope& other) = delete;
+
+    void step(){
+        ++depth;
+    }
+
+    // operations without a single path (bulk, assign) do not record a depth
+    void noDepth(){
+        depth = -1;
+    }
+
+private:
+    StatsRecorder& recorder;
+    SetOp op;
+    SpinCounters before;
+    std::uint64_t start;
+    int depth = 0;
+};
+
+#else
+
+class StatsRecorder
+{
+public:
+    static std::uint64_t now(){ return 0; }
+    void locked(std::uint64_t){}
+    void unlocking(){}
+    void readRetry(){}
+    void readFallback(){}
+    SetStats snapshot() const { return SetStats(); }
+};
+
+class StatsScope
+{
+public:
+    StatsScope(StatsRecorder&, SetOp){}
+    void step(){}
+    void noDepth(){}
+};
+
+#endif
+
+} // namespace mbu
+
+#endif // !STATS_HPP__
@@ -6,24 +6,90 @@
 #include <type_traits>
 #include <concepts>
 #include <functional>
+#include <vector>
+#include <thread>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <string>
+#include <stdexcept>
 
 
-#include "macros.hpp"
+#include "locks.hpp"
 #include "requirements.hpp"
+#include "scalable_counter.hpp"
+#include "epoch.hpp"
+#include "stats.hpp"
+#include "compare.hpp"
+#include "frozen_set.hpp"
+#include "snapshot_file.hpp"
 
 
 namespace mbu{
 
-template <class T>
+/*
+    Global    : every writer takes the set wide flag for the whole operation
+    Coupling  : writers lock nodes hand-over-hand (parent & child) so writers in disjoint subtrees run in parallel
+    Combining : flat combining, writers publish their insert / remove in a per thread slot and spin on it, the one
+                that gets the combiner token applies every published operation under flag in one pass
+*/
+enum class LockMode { Global, Coupling, Combining };
+
+/*
+    Shared     : search walks the tree through the shared_ptr links, a reference count update per level. A miss is
+                 validated against the version writers bump around the only change a reader can observe half done
+                 (see unlink) and the walk is repeated when it moved.
+    Optimistic : search pins the epoch and walks raw pointer copies of the links, validated against the same version.
+                 Unlinked nodes are retired to Epoch instead of being freed when their last reference drops.
+*/
+enum class ReadMode { Shared, Optimistic };
+
+/*
+    Alloc is rebound to the node type, every node (with its shared_ptr control block) is built by std::allocate_shared.
+    SlabAllocator from slab_allocator.hpp serves them from per-thread pools.
+
+    Lock is the policy of flag and of every node lock (see locks.hpp), anything with lock() and unlock().
+
+    T only has to be movable. insert(T&&) and emplace build the node's value in place, search and remove also take
+    any key type K that Compare can compare with T, so probing needs no T.
+
+    Compare is a three way comparator (see compare.hpp), ThreeWayCompare uses T's <=> when it has one and falls
+    back to < and == otherwise.
+*/
+template <class T, class Alloc = std::allocator<T>, class Lock = SpinLock, class Compare = ThreeWayCompare<T>>
 class ThreadSafeSet
 {
     struct Node;
+    struct Link;
+    using NodeAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+
+    // below this many keys a subtree is built by the calling thread
+    static constexpr std::size_t PARALLEL_BUILD_MIN = 1 << 14;
+
+    // validated attempts of a lock-free read before it falls back to the next kind of walk
+    static constexpr int OPTIMISTIC_RETRIES = 8;
+    // moves: (version << 16) | writers inside unlink
+    static constexpr std::uint64_t VERSION_STEP = 1 << 16;
+    static constexpr std::uint64_t ACTIVE_MASK = VERSION_STEP - 1;
+
+    // publication slots of Combining mode, threads beyond that share slots and fall back to flag on a collision
+    static constexpr int COMBINE_SLOTS = 64;
+    // scans of the slots per combiner turn, later scans pick up what was published while applying the first
+    static constexpr int COMBINE_PASSES = 2;
+    static constexpr int COMBINE_SPIN_LIMIT = 64;
 
 public:
 
-    ThreadSafeSet(){
-        static_assert(has_less_than<T>, "T must have operator<");
-        static_assert(has_equal_to<T>, "T must have operator==");
+    ThreadSafeSet(LockMode mode = LockMode::Global, const Alloc& alloc = Alloc()) : ThreadSafeSet(mode, ReadMode::Shared, alloc) {}
+    ThreadSafeSet(LockMode mode, ReadMode reads, const Alloc& alloc = Alloc(), const Compare& compare = Compare())
+        : allocator(alloc), mode(mode), reads(reads), compare(compare), combiner(makeCombiner(mode)) {
+        static_assert(std::is_invocable_v<const Compare&, const T&, const T&>, "Compare must order T, give T operator<=> or operator< and operator==");
+    }
+    // Builds a perfectly balanced tree from [first, last) in O(n) for sorted input, see assign
+    template <std::input_iterator It>
+    ThreadSafeSet(It first, It last, LockMode mode = LockMode::Global, const Alloc& alloc = Alloc()) : ThreadSafeSet(mode, alloc) {
+        assign(first, last);
     }
     ~ThreadSafeSet(){
         clear();
@@ -32,275 +98,1263 @@ public:
     ThreadSafeSet(const ThreadSafeSet& other) = delete;
     ThreadSafeSet& operator=(const ThreadSafeSet& other) = delete;
 
-    ThreadSafeSet(ThreadSafeSet&& other){
+    // The other set keeps its slots, a moved from set stays usable
+    ThreadSafeSet(ThreadSafeSet&& other) : allocator(other.allocator), mode(other.mode), reads(other.reads), compare(other.compare), combiner(makeCombiner(other.mode)) {
         root.store(other.root.load());
         other.root.store(nullptr);
+        count.reset(other.count.exact());
+        other.count.reset();
     };
     
     ThreadSafeSet& operator=(ThreadSafeSet&& other){
+        mode = other.mode;
+        reads = other.reads;
+        compare = other.compare;
+        combiner = makeCombiner(mode);
         root.store(other.root.load());
         other.root.store(nullptr);
+        count.reset(other.count.exact());
+        other.count.reset();
         return *this;
     };
 
 
+    /*
+        The value is copied (or moved) once, straight into the node, and only when it is actually added. In Combining
+        mode the node is built before the insert is published instead, so the combiner only has to link it.
+    */
     bool insert(const T& value){
+        if(mode == LockMode::Combining){
+            return emplace(value);
+        }
+        return insertWith(value, [&](){ return makeNode(value); }, [](const T&){});
+    }
 
-        ATOMIC_FLAG_LOCK(flag);
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
-        bool added = false;
-        while (true)
-        {
-            std::shared_ptr<Node> v = local.load();
-            std::shared_ptr<Node> result;
-            COMPARE_EXCHANGE_WEAK(local, v, result);
-            result = add(v, value, added);
+    bool insert(T&& value){
+        if(mode == LockMode::Combining){
+            return emplace(std::move(value));
+        }
+        return insertWith(value, [&](){ return makeNode(std::move(value)); }, [](const T&){});
+    }
 
-            if(result != nullptr){
-                root.store(result);
-                break;
+    // Builds the value in its node from args, the node is dropped again if an equal key is already there
+    template <class... Args>
+    bool emplace(Args&&... args){
+        std::shared_ptr<Node> node = makeNode(std::forward<Args>(args)...);
+        if(mode == LockMode::Combining){
+            const T& value = node->value;
+            return combine(true, value, std::move(node));
+        }
+        return insertWith(node->value, [&](){ return std::move(node); }, [](const T&){});
+    }
+
+    /*
+        One walk for find-or-insert: adds T(args...) when no value equal to key is there, otherwise calls found with
+        the stored value instead (T is only built when it is added). found runs while the writer still holds that
+        spot, flag in Global mode and the node's lock in Coupling mode, so no writer adds or removes the key
+        meanwhile. Readers are not stopped, anything found changes must be synchronized by T itself.
+        Returns true when the value was added. Used by ConcurrentMap.
+    */
+    template <class K, class Found, class... Args> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    bool emplace_or_visit(const K& key, Found&& found, Args&&... args){
+        return insertWith(key, [&](){ return makeNode(std::forward<Args>(args)...); }, found);
+    }
+
+    bool remove(const T& value){
+        if(mode == LockMode::Combining){
+            return combine(false, value, nullptr);
+        }
+        return removeKey(value);
+    }
+
+    // Heterogeneous remove, key is compared with the stored values as it is, no T is built for it
+    template <class K> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    bool remove(const K& key){
+        return removeKey(key);
+    }
+
+    bool search(const T& value) const {
+        return searchKey(value);
+    }
+
+    template <class K> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    bool search(const K& key) const {
+        return searchKey(key);
+    }
+
+    // Calls f with the stored value equal to key, if any. The node is held by the walk, a concurrent remove can not free it under f.
+    template <class K, class F> requires std::is_invocable_v<const Compare&, const K&, const T&>
+    bool visit(const K& key, F&& f) const {
+        StatsScope scope(recorder, SetOp::Search);
+        std::shared_ptr<Node> found = stableWalk([&](){ return walkTo(key, scope); }, true);
+        if(found == nullptr){
+            return false;
+        }
+        f(found->value);
+        return true;
+    }
+
+    // Maintained by the writers, exact once they are done
+    int size() const {
+        return static_cast<int>(count.exact());
+    }
+
+    // One load, never negative, off by up to about a thousand keys either way while writers run, see ScalableCounter
+    int approximate_size() const {
+        return static_cast<int>(count.approximate());
+    }
+
+    bool empty() const {
+        return root.load() == nullptr;
+    }
+
+    void clear() {
+        lockFlag();
+        drainWriters();
+        std::shared_ptr<Node> detached = root.exchange(nullptr);
+        count.reset();
+        unlockFlag();
+
+        // The old tree is torn down outside the lock, a pooling allocator then gets the freed nodes back in one batch
+        retire(std::move(detached));
+        if constexpr (requires { NodeAllocator::release(); }){
+            NodeAllocator::release();
+        }
+    }
+
+    void iterate(const std::function<void(const T&)>& func) const {
+        scan(nullptr, nullptr, func);
+    }
+
+    // Visitor overload, f is called directly (and can be inlined) instead of through std::function
+    template <class F>
+    void iterate(F&& f) const {
+        scan(nullptr, nullptr, f);
+    }
+
+    /*
+        Full scan split over threads. The top of the tree is cut into disjoint subtrees (about four per thread),
+        workers take them from a shared index and walk each in order; the keys above the cut are visited by the
+        calling thread. f is called concurrently and the overall order is unspecified.
+        The subtrees are not revalidated like iterate's walk: a successor moved by a concurrent remove may be
+        missed or reported twice, use it in read mostly phases.
+    */
+    template <class F>
+    void parallel_iterate(F&& f, unsigned threads = std::thread::hardware_concurrency()) const {
+
+        std::vector<std::shared_ptr<Node>> subtrees;
+        std::vector<std::shared_ptr<Node>> cut;
+        if(std::shared_ptr<Node> top = root.load()){
+            subtrees.push_back(std::move(top));
+        }
+
+        // breadth first: the next subtree in line is split into its node and its two children
+        std::size_t target = std::max(1u, threads) * 4;
+        std::size_t next = 0;
+        while(threads > 1 && next < subtrees.size() && subtrees.size() - next < target){
+            std::shared_ptr<Node> node = subtrees[next++];
+            if(std::shared_ptr<Node> left = node->left.load()){
+                subtrees.push_back(std::move(left));
+            }
+            if(std::shared_ptr<Node> right = node->right.load()){
+                subtrees.push_back(std::move(right));
             }
+            cut.push_back(std::move(node));
         }
-        ATOMIC_FLAG_UNLOCK(flag);
 
-        return added;
+        std::atomic<std::size_t> claimed = next;
+        auto work = [&](){
+            for(std::size_t i = claimed.fetch_add(1); i < subtrees.size(); i = claimed.fetch_add(1)){
+                inorder(subtrees[i], nullptr, nullptr, f);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for(unsigned i = 1; i < threads && i < subtrees.size() - next; ++i){
+            workers.emplace_back(work);
+        }
+        for(const std::shared_ptr<Node>& node : cut){
+            f(node->value);
+        }
+        work();
+        for(std::thread& worker : workers){
+            worker.join();
+        }
     }
 
-    bool remove(const T& value){ 
+    /*
+        Ordered queries, they only walk the O(log n + k) nodes on the boundary paths and inside the range.
+        Like iterate they run without locks and report keys in order, and like search they are validated against
+        the successor moves of concurrent removes (see scan). A key that is not written during the query is reported
+        exactly once; keys written meanwhile may or may not be.
+    */
 
-        ATOMIC_FLAG_LOCK(flag);
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
-        bool removed = false;
-        while (true)
-        {
-            std::shared_ptr<Node> v = local.load();
-            std::shared_ptr<Node> result;
-            COMPARE_EXCHANGE_WEAK(local, v, result);
-            result = remove(v, value, removed);
+    // Smallest key not less than value
+    std::optional<T> lower_bound(const T& value) const {
+        std::shared_ptr<Node> found = stableWalk([&](){
+            std::shared_ptr<Node> best;
+            std::shared_ptr<Node> current = root.load();
+            while(current != nullptr){
+                if(compare(current->value, value) < 0){
+                    current = current->right.load();
+                }else{
+                    std::shared_ptr<Node> left = current->left.load();
+                    best = std::move(current);
+                    current = std::move(left);
+                }
+            }
+            return best;
+        }, false);
+        return found != nullptr ? std::optional<T>(found->value) : std::nullopt;
+    }
 
-            if(result != nullptr){
-                root.store(result);
-                break;
+    // Smallest key greater than value
+    std::optional<T> upper_bound(const T& value) const {
+        std::shared_ptr<Node> found = stableWalk([&](){
+            std::shared_ptr<Node> best;
+            std::shared_ptr<Node> current = root.load();
+            while(current != nullptr){
+                if(compare(value, current->value) < 0){
+                    std::shared_ptr<Node> left = current->left.load();
+                    best = std::move(current);
+                    current = std::move(left);
+                }else{
+                    current = current->right.load();
+                }
             }
+            return best;
+        }, false);
+        return found != nullptr ? std::optional<T>(found->value) : std::nullopt;
+    }
+
+    // Calls f with every key in [lo, hi) in ascending order
+    template <class F>
+    void range_for_each(const T& lo, const T& hi, F&& f) const {
+        scan(&lo, &hi, f);
+    }
+
+    int count_range(const T& lo, const T& hi) const {
+        int count = 0;
+        scan(&lo, &hi, [&count](const T&){ ++count; });
+        return count;
+    }
+
+    /*
+        Read optimized immutable copy of the keys for a read only phase, see frozen_set.hpp. One in order walk and
+        one pass over the copied keys, O(n). Sees the keys like iterate does, writers are not stopped.
+    */
+    FrozenSet<T, Compare> freeze() const {
+        std::vector<T> sorted;
+        sorted.reserve(static_cast<std::size_t>(size()));
+        scan(nullptr, nullptr, [&sorted](const T& value){ sorted.push_back(value); });
+        return FrozenSet<T, Compare>(std::move(sorted), compare);
+    }
+
+    /*
+        Batch operations: the batch is sorted once and merged into the tree in a single traversal under one
+        acquisition of flag, instead of one lock handoff and one walk from the root per key.
+        Return how many keys were actually added / removed.
+    */
+    template <class It>
+    int insert_bulk(It first, It last){
+
+        StatsScope scope(recorder, SetOp::Bulk);
+        scope.noDepth();
+
+        std::vector<T> batch = sortedBatch(first, last);
+        if(batch.empty()){
+            return 0;
+        }
+
+        lockFlag();
+        std::shared_ptr<Node> top = root.load();
+        if(top == nullptr){
+            root.store(build(batch.data(), batch.data() + batch.size()));
+            count.add(static_cast<long>(batch.size()));
+            unlockFlag();
+            return static_cast<int>(batch.size());
+        }
+
+        int added = 0;
+        if(mode == LockMode::Coupling){
+            // the batch then only holds the nodes it is passing, like a single coupled writer
+            top->wait_lock();
+            writers.fetch_add(1);
+            unlockFlag();
+            added = mergeInsert(top, batch.data(), batch.data() + batch.size());
+            count.add(added);
+            writers.fetch_sub(1);
+        }else{
+            added = mergeInsert(top, batch.data(), batch.data() + batch.size());
+            count.add(added);
+            unlockFlag();
+        }
+        return added;
+    }
+
+    template <class It>
+    int remove_bulk(It first, It last){
+
+        StatsScope scope(recorder, SetOp::Bulk);
+        scope.noDepth();
+
+        std::vector<T> batch = sortedBatch(first, last);
+        if(batch.empty()){
+            return 0;
         }
-        ATOMIC_FLAG_UNLOCK(flag);
 
+        // flag is held to the end, the root link may change
+        lockFlag();
+        std::shared_ptr<Node> top = root.load();
+        int removed = 0;
+        if(top != nullptr){
+            lockNode(top);
+            removed = mergeRemove(root, top, batch.data(), batch.data() + batch.size());
+            count.add(-removed);
+        }
+        unlockFlag();
         return removed;
     }
 
-    bool search(const T& value) const {     
+    /*
+        Replaces the contents with the keys of [first, last). Sorted input is only deduplicated, anything else is
+        sorted first. The new tree is built detached, large inputs split by subtree across threads, and published
+        with a single exchange of root; readers see either the old set or the new one.
+    */
+    template <class It>
+    void assign(It first, It last, unsigned threads = std::thread::hardware_concurrency()){
 
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
-        bool result = search(local.load(), value);
+        StatsScope scope(recorder, SetOp::Bulk);
+        scope.noDepth();
 
-        return result;
+        std::vector<T> keys = sortedBatch(first, last);
+        replaceWith(keys.data(), keys.data() + keys.size(), threads);
     }
 
-    int size() const {
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
+    /*
+        Writes the keys in order to a snapshot file (see snapshot_file.hpp) that load turns back into a set.
+        The file holds the set as it was at one moment: writers are held off while the keys are copied to memory,
+        not while the file is written. Throws std::system_error when the file can not be written.
+    */
+    void save(const std::string& path) requires std::is_trivially_copyable_v<T> {
+        std::vector<T> keys;
+
+        lockFlag();
+        drainWriters();
+        // no writer runs now, the count is exact
+        keys.reserve(static_cast<std::size_t>(size()));
+        inorder(root.load(), nullptr, nullptr, [&keys](const T& value){ keys.push_back(value); });
+        unlockFlag();
 
-        return size(local.load());
+        writeSnapshot(path, keys.data(), keys.size(), sizeof(T));
     }
 
-    bool empty() const {
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
+    /*
+        Replaces the contents with a file written by save. The file is mapped and the balanced tree is built straight
+        from the mapped sorted keys like assign does, no parsing and no per key insert.
+        Throws std::system_error when the file can not be mapped and std::runtime_error when it is not a valid
+        snapshot of this T or its keys are not strictly ascending in this set's order.
+    */
+    void load(const std::string& path, unsigned threads = std::thread::hardware_concurrency()) requires std::is_trivially_copyable_v<T> {
+        StatsScope scope(recorder, SetOp::Bulk);
+        scope.noDepth();
+
+        MappedSnapshot file(path, sizeof(T));
+        const T* first = static_cast<const T*>(file.keys());
+        const T* last = first + file.count();
+        if(std::adjacent_find(first, last, [this](const T& lhs, const T& rhs){ return compare(lhs, rhs) >= 0; }) != last){
+            throw std::runtime_error(path + ": keys are not in this set's order");
+        }
+        replaceWith(first, last, threads);
+    }
 
-        return local.load() == nullptr;
+    LockMode lockMode() const {
+        return mode;
     }
 
-    void clear() {
-        ATOMIC_FLAG_LOCK(flag);
-        root.store(nullptr);
-        ATOMIC_FLAG_UNLOCK(flag);
+    ReadMode readMode() const {
+        return reads;
     }
 
-    void iterate(const std::function<void(const T&)>& func) {
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(root.load());
-        iterate(local.load(), func);
+    // What the instrumentation recorded so far, all zero unless built with MBU_SET_STATS (see stats.hpp)
+    SetStats stats() const {
+        return recorder.snapshot();
     }
 
 
 private:
 
+    /*
+        Global mode writers, see insertCoupled / removeCoupled for Coupling mode. make() builds the node to link in,
+        found(value) is called instead when an equal value is already there.
+    */
+    template <class K, class Make, class Found>
+    bool insertWith(const K& value, Make&& make, Found&& found){
+
+        StatsScope scope(recorder, SetOp::Insert);
+        if(mode == LockMode::Coupling){
+            return insertCoupled(value, make, found, scope);
+        }
 
-    /* 
-        We can improve the performance using parent & grandparent locks but we need to resolve the returning values for parent storage 
-        
-        Comment codes are for parent & grandparent locks but load & store operations are returning value for a node and a node cant handle that
-        situation. 
-        
-        We need to find a way to store the parent & grandparent nodes and return them to the add & remove functions.
-        This way we can improve the performance. nearly %75 percentage 
+        lockFlag();
+        bool added = insertLocked(value, make, found, scope);
+        unlockFlag();
+        return added;
+    }
+
+    // flag is held by the caller, it excludes every other writer, so the links walked here stay in the tree
+    template <class K, class Make, class Found>
+    bool insertLocked(const K& value, Make&& make, Found&& found, StatsScope& scope){
+        Link* link = &root;
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr){
+            scope.step();
+            auto order = compare(value, current->value);
+            if(order == 0){
+                found(current->value);
+                return false;
+            }
+            link = order < 0 ? &current->left : &current->right;
+            current = link->load();
+        }
+        link->store(make());
+        count.add(1);
+        return true;
+    }
+
+    template <class K>
+    bool removeKey(const K& value){ 
+
+        StatsScope scope(recorder, SetOp::Remove);
+        if(mode == LockMode::Coupling){
+            return removeCoupled(value, scope);
+        }
+
+        lockFlag();
+        std::shared_ptr<Node> removed = removeLocked(value, scope);
+        unlockFlag();
+        if(removed == nullptr){
+            return false;
+        }
+        retire(std::move(removed));
+        return true;
+    }
+
+    // flag is held by the caller. Returns the unlinked node (to retire once flag is released) or nullptr.
+    template <class K>
+    std::shared_ptr<Node> removeLocked(const K& value, StatsScope& scope){
+        Link* link = &root;
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr){
+            auto order = compare(value, current->value);
+            if(order == 0){
+                break;
+            }
+            scope.step();
+            link = order < 0 ? &current->left : &current->right;
+            current = link->load();
+        }
+        if(current != nullptr){
+            // the node locks unlink takes are uncontended here
+            unlink(*link, current);
+            count.add(-1);
+        }
+        return current;
+    }
+
+
+    /*
+        Combining mode writer. The operation goes into this thread's slot and the thread spins on its own slot's
+        cache line instead of on flag. Whenever the combiner token is free a waiter takes it and applies every
+        pending operation, its own included, then hands the token back. The combiner sorts what it collected so the
+        walks follow each other down the same upper levels, the tree's hot part stays in its cache.
+        An insert carries its ready node; a failed insert and a removed node go back to their owner, who drops or
+        retires them outside flag.
     */
-    
-    // std::shared_ptr<Node> add(std::shared_ptr<Node> _local, T value, std::shared_ptr<Node> parent, std::shared_ptr<Node> gParent ,bool& added){
-    std::shared_ptr<Node> add(std::shared_ptr<Node> _local, T value, bool& added){
-
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(_local);
-
-        // if(gParent != nullptr){
-        //     ATOMIC_FLAG_UNLOCK(gParent->marked);
-        // }  
-        // if(local.load() != nullptr){
-        //     ATOMIC_FLAG_LOCK(local.load()->marked);
-        // }
-
-        if(local.load() == nullptr){
-            added = true;
-            return std::make_shared<Node>(value);
-        }else{
-            if(value < local.load()->value){
+    bool combine(bool insert, const T& value, std::shared_ptr<Node> node){
+
+        StatsScope scope(recorder, insert ? SetOp::Insert : SetOp::Remove);
+        Request& request = combiner->slots[slotIndex()];
+        int expected = FREE;
+        if(!request.state.compare_exchange_strong(expected, CLAIMED, std::memory_order_acquire)){
+            // the slot is another thread's right now, take flag like a Global mode writer
+            lockFlag();
+            bool done = insert ? insertLocked(value, [&](){ return std::move(node); }, [](const T&){}, scope) : (node = removeLocked(value, scope)) != nullptr;
+            unlockFlag();
+            if(!insert){
+                retire(std::move(node));
+            }
+            return done;
+        }
+
+        request.insert = insert;
+        request.value = &value;
+        request.node = std::move(node);
+        request.scope = &scope;
+        request.state.store(PENDING, std::memory_order_release);
+
+        int spins = 0;
+        while(request.state.load(std::memory_order_acquire) != DONE){
+            if(!combiner->busy.load(std::memory_order_relaxed) && !combiner->busy.exchange(true, std::memory_order_acquire)){
+                combineAll();
+                combiner->busy.store(false, std::memory_order_release);
+            }else if(++spins < COMBINE_SPIN_LIMIT){
+                noteSpin();
+                cpuRelax();
+            }else{
+                noteYield();
+                std::this_thread::yield();
+                spins = 0;
+            }
+        }
+
+        bool done = request.result;
+        node = std::move(request.node);
+        request.state.store(FREE, std::memory_order_release);
+        if(!insert){
+            retire(std::move(node));
+        }
+        return done;
+    }
+
+    // Holder of the combiner token: applies what is pending in the slots, in key order, under flag
+    void combineAll(){
+
+        Request* batch[COMBINE_SLOTS];
+        lockFlag();
+        for(int pass = 0; pass < COMBINE_PASSES; ++pass){
+            int pending = 0;
+            for(Request& request : combiner->slots){
+                if(request.state.load(std::memory_order_acquire) == PENDING){
+                    batch[pending++] = &request;
+                }
+            }
+            if(pending == 0){
+                break;
+            }
+            std::sort(batch, batch + pending, [this](const Request* lhs, const Request* rhs){
+                return compare(*lhs->value, *rhs->value) < 0;
+            });
+
+            for(int i = 0; i < pending; ++i){
+                Request& request = *batch[i];
+                if(request.insert){
+                    request.result = insertLocked(*request.value, [&request](){ return std::move(request.node); }, [](const T&){}, *request.scope);
+                }else{
+                    request.node = removeLocked(*request.value, *request.scope);
+                    request.result = request.node != nullptr;
+                }
+                request.state.store(DONE, std::memory_order_release);
+            }
+        }
+        unlockFlag();
+    }
 
-                std::shared_ptr<Node> v = local.load()->left;
-                COMPARE_EXCHANGE_WEAK(local.load()->left, v, add(v, value, added));
-                // local.load()->left = add(local.load()->left, value, local.load(), added);
+    // Threads take the slots round robin in the order they first write, like the ScalableCounter stripes
+    static int slotIndex(){
+        static std::atomic<int> next = 0;
+        thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % COMBINE_SLOTS;
+        return index;
+    }
+
+    template <class K>
+    bool searchKey(const K& value) const {
+
+        StatsScope scope(recorder, SetOp::Search);
+        if(reads == ReadMode::Optimistic){
+            Epoch::Guard guard;
+            for(int attempt = 0; attempt < OPTIMISTIC_RETRIES; ++attempt){
+                std::uint64_t before = moves.load(std::memory_order_acquire);
+                if(before & ACTIVE_MASK){
+                    recorder.readRetry();
+                    cpuRelax();
+                    continue;
+                }
+                bool found = searchRaw(value, scope);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(moves.load(std::memory_order_relaxed) == before){
+                    return found;
+                }
+                recorder.readRetry();
             }
-            
-            if(!(value < local.load()->value) && !(value == local.load()->value)){
-                std::shared_ptr<Node> v = local.load()->right;
-                COMPARE_EXCHANGE_WEAK(local.load()->right, v, add(v, value, added));
-                // local.load()->right = add(local.load()->right, value, local.load(), added);
+            recorder.readFallback();
+        }
+        return stableWalk([&](){ return walkTo(value, scope); }, true) != nullptr;
+    }
+
+    // One shared_ptr cursor is the only state, it keeps the node it stands on alive against concurrent removes
+    template <class K>
+    std::shared_ptr<Node> walkTo(const K& value, StatsScope& scope) const {
+        std::shared_ptr<Node> current = root.load();
+        while(current != nullptr){
+            scope.step();
+            auto order = compare(value, current->value);
+            if(order == 0){
+                break;
             }
+            current = order < 0 ? current->left.load() : current->right.load();
         }
+        return current;
+    }
+
 
-        // ATOMIC_FLAG_UNLOCK(local.load()->marked);
-        return local.load();
+    // True when no successor move (see unlink) ran since moves read version
+    bool unmoved(std::uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (version & ACTIVE_MASK) == 0 && moves.load(std::memory_order_relaxed) == version;
+    }
+
+    /*
+        Runs walk (a lock-free walk over the shared_ptr links that returns the node it settles on or nullptr) until
+        no successor move ran alongside it. With trustFound a node found is taken as it is, only a miss is repeated.
+        After OPTIMISTIC_RETRIES attempts it walks once more with flag held and the coupled writers drained.
+    */
+    template <class Walk>
+    std::shared_ptr<Node> stableWalk(Walk&& walk, bool trustFound) const {
+        for(int attempt = 0; attempt < OPTIMISTIC_RETRIES; ++attempt){
+            std::uint64_t version = moves.load(std::memory_order_acquire);
+            std::shared_ptr<Node> found = walk();
+            if((trustFound && found != nullptr) || unmoved(version)){
+                return found;
+            }
+            recorder.readRetry();
+            cpuRelax();
+        }
+        recorder.readFallback();
+        lockFlag();
+        drainWriters();
+        std::shared_ptr<Node> found = walk();
+        unlockFlag();
+        return found;
     }
 
 
-    std::shared_ptr<Node> remove(std::shared_ptr<Node> _local, T value, bool& removed){
+    // Strict weak order of Compare, for the standard algorithms
+    auto less() const {
+        return [this](const T& lhs, const T& rhs){ return compare(lhs, rhs) < 0; };
+    }
 
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(_local);
 
-        if(local.load() == nullptr){
+    template <class... Args>
+    std::shared_ptr<Node> makeNode(Args&&... args){
+        return std::allocate_shared<Node>(allocator, std::in_place, std::forward<Args>(args)...);
+    }
 
-            return local;
+
+    /*
+        iterate and the range queries: the keys in [*lo, *hi) (a null bound is open) in ascending order, walked like
+        inorder. Before every key is reported moves is checked, when a successor moved meanwhile the stack is rebuilt
+        from the root for the keys above the last one reported, so the moved key is neither missed nor repeated.
+        After OPTIMISTIC_RETRIES rebuilds in a row one is done with the writers held off (f is never called under
+        flag) and its first key is taken as it is, so every key costs at most one locked rebuild.
+    */
+    template <class F>
+    void scan(const T* lo, const T* hi, F&& f) const {
+
+        std::vector<std::shared_ptr<Node>> stack;
+        std::shared_ptr<Node> last;
+        auto descend = [&](std::shared_ptr<Node> current){
+            while(current != nullptr){
+                if(last != nullptr ? compare(current->value, last->value) <= 0 : lo != nullptr && compare(current->value, *lo) < 0){
+                    current = current->right.load();
+                    continue;
+                }
+                std::shared_ptr<Node> left = current->left.load();
+                stack.push_back(std::move(current));
+                current = std::move(left);
+            }
+        };
+
+        std::uint64_t version = moves.load(std::memory_order_acquire);
+        descend(root.load());
+        int attempt = 0;
+        bool trusted = false;
+        while(true){
+            if(!trusted && !unmoved(version)){
+                recorder.readRetry();
+                stack.clear();
+                if(++attempt < OPTIMISTIC_RETRIES){
+                    cpuRelax();
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load());
+                }else{
+                    recorder.readFallback();
+                    lockFlag();
+                    drainWriters();
+                    version = moves.load(std::memory_order_acquire);
+                    descend(root.load());
+                    unlockFlag();
+                    trusted = true;
+                    attempt = 0;
+                }
+                continue;
+            }
+            trusted = false;
+            if(stack.empty()){
+                return;
+            }
+            last = std::move(stack.back());
+            stack.pop_back();
+            if(hi != nullptr && compare(last->value, *hi) >= 0){
+                return;
+            }
+            f(last->value);
+            attempt = 0;
+            descend(last->right.load());
         }
-        if(value < local.load()->value){
-            
-            std::shared_ptr<Node> v = local.load()->left;
-            COMPARE_EXCHANGE_WEAK(local.load()->left, v, remove(v, value, removed));
+    }
 
-        }else if(!(value < local.load()->value) && !(value == local.load()->value)){
 
-            std::shared_ptr<Node> v = local.load()->right;
-            COMPARE_EXCHANGE_WEAK(local.load()->right, v, remove(v, value, removed));
+    /*
+        In order walk of the keys of top's subtree in [*lo, *hi) with an explicit stack, so deep (unbalanced) trees
+        can not overflow the call stack. A null bound is open. Subtrees left of lo are never entered and the walk
+        stops at the first key not below hi. Nothing is validated, for parallel_iterate's subtrees and for walks
+        with the writers held off.
+    */
+    template <class F>
+    void inorder(std::shared_ptr<Node> current, const T* lo, const T* hi, F&& f) const {
+
+        std::vector<std::shared_ptr<Node>> stack;
+        while(current != nullptr || !stack.empty()){
+            while(current != nullptr){
+                if(lo != nullptr && compare(current->value, *lo) < 0){
+                    current = current->right.load();
+                    continue;
+                }
+                std::shared_ptr<Node> left = current->left.load();
+                stack.push_back(std::move(current));
+                current = std::move(left);
+            }
+            if(stack.empty()){
+                return;
+            }
+            const T& value = stack.back()->value;
+            if(hi != nullptr && compare(value, *hi) >= 0){
+                return;
+            }
+            f(value);
+            current = stack.back()->right.load();
+            stack.pop_back();
+        }
+    }
 
-        }else{
 
-            removed = true;
-            if(local.load()->left.load() == nullptr && local.load()->right.load() == nullptr){
+    template <class It>
+    std::vector<T> sortedBatch(It first, It last) const {
+        std::vector<T> batch(first, last);
+        if(!std::is_sorted(batch.begin(), batch.end(), less())){
+            std::sort(batch.begin(), batch.end(), less());
+        }
+        batch.erase(std::unique(batch.begin(), batch.end(), [this](const T& lhs, const T& rhs){ return compare(lhs, rhs) == 0; }), batch.end());
+        return batch;
+    }
 
-                std::shared_ptr<Node> v = local;
-                COMPARE_EXCHANGE_WEAK(local, v, nullptr);
 
-            }else if(local.load()->left.load() == nullptr){
+    // Builds the sorted unique [first, last) with up to threads builders and swaps it in for the current tree
+    void replaceWith(const T* first, const T* last, unsigned threads){
 
-                std::shared_ptr<Node> v = local;
-                COMPARE_EXCHANGE_WEAK(local, v, local.load()->right);
+        int depth = 0;
+        while((1u << (depth + 1)) <= threads){
+            ++depth;
+        }
+        std::shared_ptr<Node> built = buildParallel(first, last, depth);
+
+        lockFlag();
+        drainWriters();
+        std::shared_ptr<Node> detached = root.exchange(built);
+        count.reset(static_cast<long>(last - first));
+        unlockFlag();
+        retire(std::move(detached));
+    }
 
-            }else if(local.load()->right.load() == nullptr){
 
-                std::shared_ptr<Node> v = local;
-                COMPARE_EXCHANGE_WEAK(local, v, local.load()->left);
+    // Perfectly balanced subtree of the sorted range [first, last)
+    std::shared_ptr<Node> build(const T* first, const T* last){
+        if(first == last){
+            return nullptr;
+        }
+        const T* middle = first + (last - first) / 2;
+        std::shared_ptr<Node> node = makeNode(*middle);
+        node->left.store(build(first, middle));
+        node->right.store(build(middle + 1, last));
+        return node;
+    }
 
-            }else{
-                
-                T max = findMax(local.load()->left);
-                local.load()->value = max;
 
-                std::shared_ptr<Node> v = local.load()->left;
-                COMPARE_EXCHANGE_WEAK(local.load()->left, v, remove(v, max, removed));
+    // The left half of each of the top depth levels is built by a new thread, 2^depth builders in total
+    std::shared_ptr<Node> buildParallel(const T* first, const T* last, int depth){
+        if(depth == 0 || static_cast<std::size_t>(last - first) < PARALLEL_BUILD_MIN){
+            return build(first, last);
+        }
+        const T* middle = first + (last - first) / 2;
+        std::shared_ptr<Node> left;
+        std::thread builder([&](){ left = buildParallel(first, middle, depth - 1); });
+        std::shared_ptr<Node> right = buildParallel(middle + 1, last, depth - 1);
+        builder.join();
+
+        std::shared_ptr<Node> node = makeNode(*middle);
+        node->left.store(left);
+        node->right.store(right);
+        return node;
+    }
 
-                local.load()->right.store(remove(local.load()->right, local.load()->value, removed));
-            }
+
+    // Node locks are only taken in Coupling mode, in Global mode flag already excludes every other writer
+    void lockNode(const std::shared_ptr<Node>& node){
+        if(mode == LockMode::Coupling){
+            node->wait_lock();
         }
+    }
 
-        return local;
+    void unlockNode(const std::shared_ptr<Node>& node){
+        if(mode == LockMode::Coupling){
+            node->unlock();
+        }
     }
 
 
-    T findMin(std::shared_ptr<Node> local){
-        while(local->left.load() != nullptr){
-            local = local->left;
+    /*
+        Splits the sorted batch around each node, an empty side gets a balanced subtree of its part in one store.
+        A node is locked when its part is pushed and released once both children that still need work are locked.
+        The pending parts are kept on an explicit stack like inorder's, a degenerate tree can not overflow the call stack.
+    */
+    int mergeInsert(std::shared_ptr<Node> top, const T* first, const T* last){
+
+        struct Part
+        {
+            std::shared_ptr<Node> node;
+            const T* first;
+            const T* last;
+        };
+
+        int added = 0;
+        std::vector<Part> stack;
+        stack.push_back({std::move(top), first, last});
+        while(!stack.empty()){
+            Part part = std::move(stack.back());
+            stack.pop_back();
+            const std::shared_ptr<Node>& node = part.node;
+
+            const T* split = std::lower_bound(part.first, part.last, node->value, less());
+            const T* rightBegin = (split != part.last && compare(*split, node->value) == 0) ? split + 1 : split;
+
+            std::shared_ptr<Node> left;
+            std::shared_ptr<Node> right;
+
+            if(part.first != split){
+                left = node->left.load();
+                if(left == nullptr){
+                    node->left.store(build(part.first, split));
+                    added += static_cast<int>(split - part.first);
+                }else{
+                    lockNode(left);
+                }
+            }
+            if(rightBegin != part.last){
+                right = node->right.load();
+                if(right == nullptr){
+                    node->right.store(build(rightBegin, part.last));
+                    added += static_cast<int>(part.last - rightBegin);
+                }else{
+                    lockNode(right);
+                }
+            }
+            unlockNode(node);
+
+            // the left part is popped first, the same order the recursion took
+            if(right != nullptr){
+                stack.push_back({std::move(right), rightBegin, part.last});
+            }
+            if(left != nullptr){
+                stack.push_back({std::move(left), part.first, split});
+            }
         }
-        return local->value;
+        return added;
     }
 
 
-    T findMax(std::shared_ptr<Node> local){
-        while(local->right.load() != nullptr){
-            local = local->right;
+    /*
+        Post-order: both sides of a node are finished before the node itself is unlinked from its link. Every node
+        is locked before its part is pushed and released when the part is done. An explicit stack of parts, see
+        mergeInsert; a part goes through its left side, then its right side, then the node itself.
+    */
+    int mergeRemove(Link& link, std::shared_ptr<Node> top, const T* first, const T* last){
+
+        enum Stage { LEFT, RIGHT, SELF };
+        struct Part
+        {
+            Link* link;
+            std::shared_ptr<Node> node;
+            const T* first;
+            const T* last;
+            const T* split;
+            bool hit;
+            Stage stage;
+        };
+
+        int removed = 0;
+        std::vector<Part> stack;
+        auto push = [&](Link* link, std::shared_ptr<Node> node, const T* first, const T* last){
+            const T* split = std::lower_bound(first, last, node->value, less());
+            bool hit = split != last && compare(*split, node->value) == 0;
+            stack.push_back({link, std::move(node), first, last, split, hit, LEFT});
+        };
+        push(&link, std::move(top), first, last);
+
+        while(!stack.empty()){
+            Part& part = stack.back();
+            const T* rightBegin = part.hit ? part.split + 1 : part.split;
+
+            if(part.stage == LEFT){
+                part.stage = RIGHT;
+                if(part.first != part.split){
+                    std::shared_ptr<Node> left = part.node->left.load();
+                    if(left != nullptr){
+                        lockNode(left);
+                        // part is not used again after the push, it may move
+                        push(&part.node->left, std::move(left), part.first, part.split);
+                    }
+                }
+                continue;
+            }
+            if(part.stage == RIGHT){
+                part.stage = SELF;
+                if(rightBegin != part.last){
+                    std::shared_ptr<Node> right = part.node->right.load();
+                    if(right != nullptr){
+                        lockNode(right);
+                        push(&part.node->right, std::move(right), rightBegin, part.last);
+                    }
+                }
+                continue;
+            }
+
+            std::shared_ptr<Node> node = std::move(part.node);
+            Link* nodeLink = part.link;
+            bool hit = part.hit;
+            stack.pop_back();
+            if(hit){
+                unlink(*nodeLink, node);
+                ++removed;
+            }
+            unlockNode(node);
+            if(hit){
+                retire(std::move(node));
+            }
         }
-        return local->value;
+        return removed;
     }
 
 
-    bool search(std::shared_ptr<Node> _local, T value) const {
+    /* 
+        Lock coupling (hand-over-hand) writers.
 
-        std::atomic<std::shared_ptr<Node>> local;
-        local.store(_local);
+        The flag guards the root link, every node's marked lock guards its own left & right links.
+        A writer holds at most the lock of the link it may change (parent) and the node it is looking at (child),
+        the parent is released as soon as the child is locked so writers in disjoint subtrees do not wait each other.
+        Node values are never changed in place, a node with two children is replaced by a fresh copy holding the successor
+        so the lock-free readers always see a consistent node.
+    */
+    template <class K, class Make, class Found>
+    bool insertCoupled(const K& value, Make& make, Found& found, StatsScope& scope){
+
+        lockFlag();
+        std::shared_ptr<Node> current = root.load();
+        if(current == nullptr){
+            root.store(make());
+            count.add(1);
+            unlockFlag();
+            return true;
+        }
+        current->wait_lock();
+        writers.fetch_add(1);
+        unlockFlag();
+
+        while(true){
+            scope.step();
+            auto order = compare(value, current->value);
+            if(order == 0){
+                found(current->value);
+                current->unlock();
+                writers.fetch_sub(1);
+                return false;
+            }
+
+            Link& link = order < 0 ? current->left : current->right;
+            std::shared_ptr<Node> next = link.load();
+            if(next == nullptr){
+                link.store(make());
+                count.add(1);
+                current->unlock();
+                writers.fetch_sub(1);
+                return true;
+            }
+
+            next->wait_lock();
+            current->unlock();
+            current = next;
+        }
+    }
+
+
+    template <class K>
+    bool removeCoupled(const K& value, StatsScope& scope){
 
-        if(local.load() == nullptr){
+        lockFlag();
+        std::shared_ptr<Node> current = root.load();
+        if(current == nullptr){
+            unlockFlag();
             return false;
         }
-        if(value < local.load()->value){
-            return search(local.load()->left, value);
-        }else if(!(value < local.load()->value) && !(value == local.load()->value)){
-            return search(local.load()->right, value);
+        current->wait_lock();
+        writers.fetch_add(1);
+
+        // parent == nullptr means the link is root and it is guarded by flag
+        std::shared_ptr<Node> parent;
+        Link* link = &root;
+
+        for(auto order = compare(value, current->value); order != 0; order = compare(value, current->value)){
+
+            scope.step();
+            Link& nextLink = order < 0 ? current->left : current->right;
+            std::shared_ptr<Node> next = nextLink.load();
+            if(next == nullptr){
+                current->unlock();
+                release(parent);
+                writers.fetch_sub(1);
+                return false;
+            }
+
+            next->wait_lock();
+            release(parent);
+            parent = current;
+            link = &nextLink;
+            current = next;
+        }
+
+        unlink(*link, current);
+        count.add(-1);
+        current->unlock();
+        release(parent);
+        writers.fetch_sub(1);
+        retire(std::move(current));
+        return true;
+    }
+
+
+    // Both the owner of link and current must be locked by the caller
+    void unlink(Link& link, const std::shared_ptr<Node>& current){
+
+        std::shared_ptr<Node> left = current->left.load();
+        std::shared_ptr<Node> right = current->right.load();
+
+        if(left == nullptr){
+            link.store(right);
+            return;
+        }
+        if(right == nullptr){
+            link.store(left);
+            return;
+        }
+
+        // current stays locked while the successor path is locked hand-over-hand
+        std::shared_ptr<Node> sParent = current;
+        std::shared_ptr<Node> successor = right;
+        successor->wait_lock();
+        for(std::shared_ptr<Node> next = successor->left.load(); next != nullptr; next = successor->left.load()){
+            next->wait_lock();
+            if(sParent != current){
+                sParent->unlock();
+            }
+            sParent = successor;
+            successor = next;
+        }
+
+        // every lock-free reader validates against this window, see stableWalk and scan
+        moves.fetch_add(1);
+        if constexpr (std::is_copy_constructible_v<T>){
+            /*
+                The replacement is published before the successor is detached. A reader that passed current before
+                the swap and is still on its way down to the successor misses its key once sParent lets go of it,
+                and an in order walk can meet the key twice; the moves window around this sends them back.
+            */
+            std::shared_ptr<Node> replacement = makeNode(successor->value);
+            replacement->left.store(left);
+            replacement->right.store(right);
+            link.store(replacement);
+
+            if(sParent == current){
+                replacement->right.store(successor->right.load());
+            }else{
+                sParent->left.store(successor->right.load());
+                sParent->unlock();
+            }
         }else{
-            return true;
+            /*
+                A move-only value can not be copied, the successor node itself is moved up into current's place.
+                It is detached from sParent before it gets current's links, so the tree never holds it twice and
+                its new right link can not close a loop back to it. Its key is unreachable until link publishes it
+                and a reader still standing on it is led to current's subtrees; the moves window around this sends
+                both back.
+            */
+            if(sParent != current){
+                sParent->left.store(successor->right.load());
+                successor->right.store(right);
+            }
+            successor->left.store(left);
+            link.store(successor);
+            if(sParent != current){
+                sParent->unlock();
+            }
+        }
+        moves.fetch_add(VERSION_STEP - 1);
+        successor->unlock();
+        if constexpr (std::is_copy_constructible_v<T>){
+            retire(std::move(successor));
         }
     }
 
-    int size(std::shared_ptr<Node> local) const {
-        if(local == nullptr)
-            return 0;
-        else
-            return 1 + size(local->left) + size(local->right);
+
+    // Called with flag held: waits for the coupled writers that already left flag behind to finish
+    void drainWriters() const {
+        while(writers.load() != 0){
+            noteYield();
+            std::this_thread::yield();
+        }
     }
 
 
-    void iterate(std::shared_ptr<Node> local, std::function<void(T)> f) const {
-        if(local != nullptr){
-            iterate(local->left, f);
-            f(local->value);
-            iterate(local->right, f);
+    // flag with its wait and hold times recorded
+    void lockFlag() const {
+        std::uint64_t start = StatsRecorder::now();
+        flag.lock();
+        recorder.locked(start);
+    }
+
+    void unlockFlag() const {
+        recorder.unlocking();
+        flag.unlock();
+    }
+
+
+    // Drops a reference to a node (or tree) taken out of the set, in Optimistic mode only after the grace period
+    void retire(std::shared_ptr<Node> node) const {
+        if(reads == ReadMode::Optimistic && node != nullptr){
+            Epoch::retire(new std::shared_ptr<Node>(std::move(node)));
         }
     }
 
 
+    // Unsynchronized walk over the raw links, the caller pins the epoch and validates the result
+    template <class K>
+    bool searchRaw(const K& value, StatsScope& scope) const {
+        const Node* current = root.raw.load(std::memory_order_acquire);
+
+        while(current != nullptr){
+            scope.step();
+            auto order = compare(value, current->value);
+            if(order == 0){
+                return true;
+            }
+            current = order < 0 ? current->left.raw.load(std::memory_order_acquire)
+                                : current->right.raw.load(std::memory_order_acquire);
+        }
+        return false;
+    }
+
+
+    void release(const std::shared_ptr<Node>& parent){
+        if(parent != nullptr){
+            parent->unlock();
+        }else{
+            unlockFlag();
+        }
+    }
+
+
+    // A shared_ptr link with a raw pointer copy for the optimistic readers, both written only by lock holders
+    struct Link
+    {
+        std::atomic<std::shared_ptr<Node>> ptr;
+        std::atomic<Node*> raw = nullptr;
+
+        std::shared_ptr<Node> load() const {
+            return ptr.load();
+        }
+
+        void store(std::shared_ptr<Node> node){
+            raw.store(node.get(), std::memory_order_release);
+            ptr.store(std::move(node));
+        }
+
+        std::shared_ptr<Node> exchange(std::shared_ptr<Node> node){
+            raw.store(node.get(), std::memory_order_release);
+            return ptr.exchange(std::move(node));
+        }
+    };
+
+    // FREE -> CLAIMED (owner fills it) -> PENDING -> DONE (combiner filled result) -> FREE (owner took it)
+    enum RequestState { FREE, CLAIMED, PENDING, DONE };
+
+    // One publication slot, the owner spins on its own cache line
+    struct alignas(64) Request
+    {
+        std::atomic<int> state = FREE;
+        bool insert = false;
+        bool result = false;
+        const T* value = nullptr;
+        std::shared_ptr<Node> node;
+        StatsScope* scope = nullptr;
+    };
+
+    struct Combiner
+    {
+        alignas(64) std::atomic<bool> busy = false;
+        Request slots[COMBINE_SLOTS];
+    };
+
+    // Only Combining mode pays for the slots
+    static std::unique_ptr<Combiner> makeCombiner(LockMode mode){
+        return mode == LockMode::Combining ? std::make_unique<Combiner>() : nullptr;
+    }
+
     struct Node
     {
         T value;
-        std::atomic<std::shared_ptr<Node>> left;
-        std::atomic<std::shared_ptr<Node>> right;
+        Link left;
+        Link right;
 
-        std::atomic_flag marked = ATOMIC_FLAG_INIT;
+        Lock marked;
 
 
-        Node(T value) : value(value), left(nullptr), right(nullptr) {}
+        template <class... Args>
+        Node(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {}
 
         void wait_lock(){
-            ATOMIC_FLAG_LOCK(marked);
+            marked.lock();
         }
 
         void unlock(){
-            ATOMIC_FLAG_UNLOCK(marked);
+            marked.unlock();
         }
 
     };
 
-    std::atomic<std::shared_ptr<Node>> root;
-    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    NodeAllocator allocator;
+    Link root;
+    // mutable: readers take it too once their lock-free walk keeps failing validation
+    mutable Lock flag;
+    LockMode mode;
+    ReadMode reads;
+    [[no_unique_address]] Compare compare;
+    std::atomic<std::uint64_t> moves = 0;
+    std::unique_ptr<Combiner> combiner;
+
+    [[no_unique_address]] mutable StatsRecorder recorder;
+
+    ScalableCounter count;
+    // coupled writers that released flag but still hold node locks, clear and assign wait for them
+    std::atomic<int> writers = 0;
 
 };
 
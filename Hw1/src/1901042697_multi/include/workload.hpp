@@ -0,0 +1,190 @@
+#ifndef WORKLOAD_HPP__
+#define WORKLOAD_HPP__
+
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+
+/*
+    Building blocks of the workload benchmark (benchmark.cpp, make bench): key generators and a latency histogram
+    fine enough for p99.9.
+*/
+
+namespace mbu{
+
+enum class KeyDistribution { Uniform, Sequential, Zipfian };
+
+inline KeyDistribution parseDistribution(const std::string& name){
+    if(name == "uniform")       return KeyDistribution::Uniform;
+    if(name == "sequential")    return KeyDistribution::Sequential;
+    if(name == "zipfian")       return KeyDistribution::Zipfian;
+    throw std::invalid_argument("unknown key distribution: " + name);
+}
+
+inline const char* distributionName(KeyDistribution distribution){
+    switch(distribution){
+        case KeyDistribution::Uniform:      return "uniform";
+        case KeyDistribution::Sequential:   return "sequential";
+        case KeyDistribution::Zipfian:      return "zipfian";
+    }
+    return "";
+}
+
+
+/*
+    Zipfian ranks over [0, keys) after Gray et al. "Quickly generating billion-record synthetic databases", the
+    generator YCSB uses. Rank 0 is the hottest key. zeta(keys) is O(keys) so it is computed once and shared,
+    sampling is O(1).
+*/
+class ZipfianTable
+{
+public:
+
+    ZipfianTable(std::uint64_t keys, double theta) : keys(keys), theta(theta) {
+        double zeta2 = 0;
+        for(std::uint64_t i = 1; i <= keys; ++i){
+            zetaN += 1.0 / std::pow(static_cast<double>(i), theta);
+            if(i == 2){
+                zeta2 = zetaN;
+            }
+        }
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / keys, 1.0 - theta)) / (1.0 - zeta2 / zetaN);
+    }
+
+    // u uniform in [0, 1)
+    std::uint64_t rank(double u) const {
+        double uz = u * zetaN;
+        if(uz < 1.0){
+            return 0;
+        }
+        if(uz < 1.0 + std::pow(0.5, theta)){
+            return 1;
+        }
+        std::uint64_t result = static_cast<std::uint64_t>(keys * std::pow(eta * u - eta + 1.0, alpha));
+        return result < keys ? result : keys - 1;
+    }
+
+private:
+    std::uint64_t keys;
+    double theta;
+    double zetaN = 0;
+    double alpha;
+    double eta;
+};
+
+
+// Per thread key source, sequential threads walk their own stripe of the key space
+class KeyGenerator
+{
+public:
+
+    KeyGenerator(KeyDistribution distribution, std::uint64_t keys, const ZipfianTable* zipfian, int thread, int threads, std::uint64_t seed)
+        : distribution(distribution), keys(keys), zipfian(zipfian), rng(seed + thread),
+          next(keys / threads * thread) {}
+
+    std::uint64_t operator()(){
+        switch(distribution){
+            case KeyDistribution::Uniform:
+                return rng() % keys;
+            case KeyDistribution::Sequential:
+                if(next >= keys){
+                    next = 0;
+                }
+                return next++;
+            case KeyDistribution::Zipfian:
+                return zipfian->rank(unit(rng));
+        }
+        return 0;
+    }
+
+    // Uniform in [0, 100), used to pick the operation
+    int percent(){
+        return static_cast<int>(rng() % 100);
+    }
+
+private:
+    KeyDistribution distribution;
+    std::uint64_t keys;
+    const ZipfianTable* zipfian;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    std::uint64_t next;
+};
+
+
+/*
+    Log-linear latency histogram in nanoseconds: every power of two is split into 16 linear sub buckets, so a
+    percentile is off by at most 1/16 (6%) instead of the factor two of the log2 Histogram in stats.hpp.
+    Single threaded, every benchmark thread fills its own and they are merged at the end.
+*/
+class LatencyHistogram
+{
+public:
+
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    void record(std::uint64_t nanoseconds){
+        ++buckets[bucketOf(nanoseconds)];
+        ++total;
+    }
+
+    std::uint64_t count() const {
+        return total;
+    }
+
+    // Upper bound of the bucket holding the q quantile (0 < q <= 1)
+    std::uint64_t percentile(double q) const {
+        std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(q * total));
+        std::uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; ++i){
+            seen += buckets[i];
+            if(seen != 0 && seen >= rank){
+                return upperBound(i);
+            }
+        }
+        return 0;
+    }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& other){
+        for(int i = 0; i < BUCKETS; ++i){
+            buckets[i] += other.buckets[i];
+        }
+        total += other.total;
+        return *this;
+    }
+
+private:
+
+    // values below SUB_BUCKETS get a bucket each, above that bucket = (msb - SUB_BITS + 1) * 16 + next 4 bits
+    static int bucketOf(std::uint64_t value){
+        if(value < SUB_BUCKETS){
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static std::uint64_t upperBound(int bucket){
+        if(bucket < SUB_BUCKETS){
+            return bucket;
+        }
+        int shift = bucket / SUB_BUCKETS - 1;
+        std::uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+
+    std::array<std::uint64_t, BUCKETS> buckets{};
+    std::uint64_t total = 0;
+};
+
+} // namespace mbu
+
+#endif // !WORKLOAD_HPP__
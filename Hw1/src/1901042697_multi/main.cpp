@@ -1,17 +1,739 @@
 #include <iostream>
 #include <thread>
+#include <atomic>
 #include <random>
 #include <iomanip>
 #include <algorithm>
 #include <chrono>
+#include <string>
+#include <map>
+#include <mutex>
 
 #include "./include/thread_safe_set.hpp"
+#include "./include/balanced_thread_safe_set.hpp"
+#include "./include/concurrent_skip_list_set.hpp"
+#include "./include/epoch_thread_safe_set.hpp"
+#include "./include/persistent_thread_safe_set.hpp"
+#include "./include/slab_allocator.hpp"
+#include "./include/locks.hpp"
+#include "./include/sharded_thread_safe_set.hpp"
+#include "./include/concurrent_hash_set.hpp"
+#include "./include/blink_tree_set.hpp"
+#include "./include/concurrent_map.hpp"
 #include "./include/custom_type.hpp"
 #include "./include/random_generator.hpp"
 
 
-int main(){
-    
+/*
+    Writer throughput for 1..max_threads writers, each writer inserts then removes its own slice of the keys
+    usage: ./executable writers [max_threads]
+*/
+void benchmarkWriters(int maxThreads){
+
+    constexpr int SIZE = 100000;
+    std::vector<int> values(SIZE);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    std::cout << "threads, mode, ms, ops/ms" << std::endl;
+    for(mbu::LockMode mode : {mbu::LockMode::Global, mbu::LockMode::Coupling, mbu::LockMode::Combining}){
+        for(int num_threads = 1; num_threads <= maxThreads; ++num_threads){
+
+            mbu::ThreadSafeSet<CustomType> set(mode);
+            std::vector<std::thread> writers;
+            int chunk_size = SIZE / num_threads;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for(int t = 0; t < num_threads; ++t){
+                writers.push_back(std::thread([&, t](){
+                    for(int i = t*chunk_size; i < (t+1)*chunk_size; ++i)
+                        set.insert(CustomType(values[i]));
+                    for(int i = t*chunk_size; i < (t+1)*chunk_size; ++i)
+                        set.remove(CustomType(values[i]));
+                }));
+            }
+            for(auto& thread : writers)
+                thread.join();
+            auto end = std::chrono::high_resolution_clock::now();
+
+            double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            std::cout << num_threads << ", " << (mode == mbu::LockMode::Global ? "global" : mode == mbu::LockMode::Coupling ? "coupling" : "combining") << ", "
+                      << ms << ", " << 2.0 * chunk_size * num_threads / ms << std::endl;
+        }
+    }
+}
+
+
+/*
+    Ascending keys (sequence ids) inserted by num_threads writers, then every second key removed concurrently
+    usage: ./executable balanced [size] [threads]
+*/
+void benchmarkBalanced(int size, int num_threads){
+
+    mbu::BalancedThreadSafeSet<CustomType> set;
+    std::vector<std::thread> threads;
+    int chunk_size = size / num_threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int t = 0; t < num_threads; ++t){
+        threads.push_back(std::thread([&, t](){
+            for(int i = t*chunk_size; i < (t+1)*chunk_size; ++i)
+                set.insert(CustomType(i));
+        }));
+    }
+    for(auto& thread : threads)
+        thread.join();
+    auto inserted = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Inserted " << set.size() << " ascending keys in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(inserted - start).count() << " ms, height: " << set.height() << std::endl;
+
+    threads.clear();
+    for(int t = 0; t < num_threads; ++t){
+        threads.push_back(std::thread([&, t](){
+            for(int i = t*chunk_size; i < (t+1)*chunk_size; i += 2)
+                set.remove(CustomType(i));
+        }));
+    }
+    for(auto& thread : threads)
+        thread.join();
+    auto removed = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Removed every second key in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(removed - inserted).count() << " ms, size: " << set.size()
+              << ", height: " << set.height() << std::endl;
+}
+
+
+/*
+    Lookups/ms of a prefilled set for 1..32 reader threads, every thread searches the whole key range
+*/
+template <class Set>
+void measureReads(Set& set, const std::vector<int>& values, const std::string& name){
+
+    for(int num_threads = 1; num_threads <= 32; num_threads *= 2){
+
+        // the hits are summed up so an inlined search can not be optimized away
+        std::atomic<long> found = 0;
+        std::vector<std::thread> readers;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int t = 0; t < num_threads; ++t){
+            readers.push_back(std::thread([&](){
+                long hits = 0;
+                for(int value : values)
+                    hits += set.search(CustomType(value));
+                found += hits;
+            }));
+        }
+        for(auto& thread : readers)
+            thread.join();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << num_threads << ", " << name << ", " << ms << ", " << values.size() * num_threads / ms << std::endl;
+    }
+}
+
+
+/*
+    Read throughput of the shared_ptr tree against the epoch reclaimed raw pointer tree
+    usage: ./executable readers [size]
+*/
+void benchmarkReaders(int size){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    mbu::ThreadSafeSet<CustomType> shared;
+    mbu::ThreadSafeSet<CustomType> optimistic(mbu::LockMode::Global, mbu::ReadMode::Optimistic);
+    mbu::EpochThreadSafeSet<CustomType> epoch;
+    for(int value : values){
+        shared.insert(CustomType(value));
+        optimistic.insert(CustomType(value));
+        epoch.insert(CustomType(value));
+    }
+
+    std::cout << "threads, set, ms, lookups/ms" << std::endl;
+    measureReads(shared, values, "shared_ptr");
+    measureReads(optimistic, values, "optimistic");
+    measureReads(epoch, values, "epoch");
+}
+
+
+/*
+    A reporting thread scans snapshots while writers keep ingesting, every scan must see the size its snapshot had
+    usage: ./executable snapshot [size] [writers]
+*/
+void benchmarkSnapshot(int size, int num_threads){
+
+    mbu::PersistentThreadSafeSet<CustomType> set;
+    std::vector<std::thread> writers;
+    std::atomic<bool> done = false;
+    int chunk_size = size / num_threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int t = 0; t < num_threads; ++t){
+        writers.push_back(std::thread([&, t](){
+            for(int i = t*chunk_size; i < (t+1)*chunk_size; ++i)
+                set.insert(CustomType(i));
+        }));
+    }
+
+    int scans = 0;
+    bool consistent = true;
+    std::thread reporter([&](){
+        while(!done.load()){
+            auto view = set.snapshot();
+            int first = view.size();
+            int second = 0;
+            view.iterate([&second](const CustomType&){ ++second; });
+            consistent = consistent && first == second;
+            ++scans;
+        }
+    });
+
+    for(auto& thread : writers)
+        thread.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    done.store(true);
+    reporter.join();
+
+    std::cout << "Inserted " << set.size() << " keys in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+              << " ms while " << scans << " snapshot scans ran, consistent: " << consistent << std::endl;
+}
+
+
+/*
+    rounds x (concurrent inserts of every key, then clear), returns the total ms
+*/
+template <class Set>
+double measureInsertClear(Set& set, const std::vector<int>& values, int num_threads, int rounds){
+
+    int chunk_size = values.size() / num_threads;
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int round = 0; round < rounds; ++round){
+        std::vector<std::thread> writers;
+        for(int t = 0; t < num_threads; ++t){
+            writers.push_back(std::thread([&, t](){
+                for(int i = t*chunk_size; i < (t+1)*chunk_size; ++i)
+                    set.insert(CustomType(values[i]));
+            }));
+        }
+        for(auto& thread : writers)
+            thread.join();
+        set.clear();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+/*
+    Insert heavy load with the default allocator against the per-thread SlabAllocator
+    usage: ./executable allocator [size] [threads] [rounds]
+*/
+void benchmarkAllocator(int size, int num_threads, int rounds){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    mbu::ThreadSafeSet<CustomType> standard(mbu::LockMode::Coupling);
+    double standardMs = measureInsertClear(standard, values, num_threads, rounds);
+
+    mbu::ThreadSafeSet<CustomType, mbu::SlabAllocator<CustomType>> pooled(mbu::LockMode::Coupling);
+    double pooledMs = measureInsertClear(pooled, values, num_threads, rounds);
+    mbu::SlabStats stats = mbu::SlabPool::stats();
+
+    // every node is one allocate_shared, with std::allocator each of them is a system allocation
+    std::cout << "std::allocator : " << standardMs << " ms, system allocations: " << stats.allocations << std::endl;
+    std::cout << "SlabAllocator  : " << pooledMs << " ms, system allocations: " << stats.slabs
+              << " (node allocations " << stats.allocations << ", frees " << stats.deallocations << ")" << std::endl;
+    std::cout << "Saved " << standardMs - pooledMs << " ms" << std::endl;
+}
+
+
+/*
+    Writers on one ThreadSafeSet against 8 hash and 8 range partitioned shards
+    usage: ./executable sharded [size] [threads]
+*/
+void benchmarkSharded(int size, int num_threads){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    mbu::ThreadSafeSet<CustomType> single;
+    std::cout << "single set : " << measureInsertClear(single, values, num_threads, 1) << " ms" << std::endl;
+
+    mbu::ShardedThreadSafeSet<CustomType, 8> hashed;
+    std::cout << "8 hashed   : " << measureInsertClear(hashed, values, num_threads, 1) << " ms" << std::endl;
+
+    std::array<CustomType, 7> bounds = {CustomType(0), CustomType(0), CustomType(0), CustomType(0), CustomType(0), CustomType(0), CustomType(0)};
+    for(int i = 0; i < 7; ++i){
+        bounds[i] = CustomType((i + 1) * size / 8);
+    }
+    mbu::ShardedThreadSafeSet<CustomType, 8, mbu::RangePartition<CustomType, 8>> ranged{mbu::RangePartition<CustomType, 8>(bounds)};
+    std::cout << "8 ranges   : " << measureInsertClear(ranged, values, num_threads, 1) << " ms" << std::endl;
+
+    for(int value : values)
+        ranged.insert(CustomType(value));
+    int previous = -1;
+    bool sorted = true;
+    ranged.iterate([&](const CustomType& obj){
+        sorted = sorted && previous < obj.x;
+        previous = obj.x;
+    });
+    std::cout << "Range shards size: " << ranged.size() << ", iterate sorted: " << sorted << std::endl;
+}
+
+
+/*
+    Membership lookups on the ordered tree, its frozen copy and the open addressing hash set
+    usage: ./executable membership [size]
+*/
+void benchmarkMembership(int size){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    mbu::ThreadSafeSet<CustomType> tree;
+    mbu::ConcurrentHashSet<CustomType> hash;
+    for(int value : values){
+        tree.insert(CustomType(value));
+        hash.insert(CustomType(value));
+    }
+
+    mbu::FrozenSet<CustomType> frozen = tree.freeze();
+
+    std::cout << "threads, set, ms, lookups/ms" << std::endl;
+    measureReads(tree, values, "tree");
+    measureReads(frozen, values, "frozen");
+    measureReads(hash, values, "hash");
+}
+
+
+/*
+    Per key counters: a ThreadSafeSet of the keys plus a mutex guarded std::map of the payloads (two lookups, two
+    locks) against one ConcurrentMap::compute per request
+    usage: ./executable map [size] [threads]
+*/
+void benchmarkMap(int size, int num_threads){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    auto measure = [&](auto&& request){
+        std::vector<std::thread> threads;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int t = 0; t < num_threads; ++t){
+            threads.push_back(std::thread([&, t](){
+                for(int i = 0; i < size; ++i)
+                    request(values[(i + t * size / num_threads) % size]);
+            }));
+        }
+        for(auto& thread : threads)
+            thread.join();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    mbu::ThreadSafeSet<CustomType> keys;
+    std::map<int, int> payloads;
+    std::mutex payloadLock;
+    double split = measure([&](int key){
+        keys.insert(CustomType(key));
+        std::lock_guard<std::mutex> guard(payloadLock);
+        ++payloads[key];
+    });
+
+    mbu::ConcurrentMap<CustomType, int> map;
+    double single = measure([&](int key){
+        map.compute(CustomType(key), [](int& count){ ++count; });
+    });
+
+    long splitTotal = 0, mapTotal = 0;
+    for(const auto& [key, count] : payloads)
+        splitTotal += count;
+    map.iterate([&](const CustomType&, int count){ mapTotal += count; });
+
+    std::cout << "set + locked map : " << split << " ms, total " << splitTotal << std::endl;
+    std::cout << "ConcurrentMap    : " << single << " ms, total " << mapTotal << std::endl;
+}
+
+
+/*
+    Cold start: refilling a set key by key against save once and load the snapshot file
+    usage: ./executable restart [size] [path]
+*/
+void benchmarkRestart(int size, const std::string& path){
+
+    std::vector<int> values(size);
+    std::iota(begin(values), end(values), 0);
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    auto elapsed = [](auto start){
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    mbu::ThreadSafeSet<CustomType> set;
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int value : values)
+        set.insert(CustomType(value));
+    std::cout << "insert one by one : " << elapsed(start) << " ms" << std::endl;
+
+    start = std::chrono::high_resolution_clock::now();
+    set.save(path);
+    std::cout << "save              : " << elapsed(start) << " ms" << std::endl;
+
+    mbu::ThreadSafeSet<CustomType> loaded;
+    start = std::chrono::high_resolution_clock::now();
+    loaded.load(path);
+    std::cout << "load              : " << elapsed(start) << " ms" << std::endl;
+
+    bool same = loaded.size() == set.size();
+    for(int i = 0; i < size && same; i += 1 + size / 1000)
+        same = loaded.search(CustomType(values[i]));
+    std::cout << "Loaded size: " << loaded.size() << ", same keys: " << same << std::endl;
+}
+
+
+/*
+    Ingest in batches: one insert/remove per key against insert_bulk/remove_bulk per batch
+    usage: ./executable bulk [size] [batch]
+*/
+void benchmarkBulk(int size, int batch){
+
+    std::vector<CustomType> values;
+    for(int i = 0; i < size; ++i)
+        values.push_back(CustomType(i));
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    mbu::ThreadSafeSet<CustomType> single;
+    auto start = std::chrono::high_resolution_clock::now();
+    for(const CustomType& value : values)
+        single.insert(value);
+    for(const CustomType& value : values)
+        single.remove(value);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "per key : " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+              << " ms, lock acquisitions: " << 2 * size << std::endl;
+
+    mbu::ThreadSafeSet<CustomType> bulk;
+    int added = 0;
+    int removed = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < size; i += batch)
+        added += bulk.insert_bulk(values.begin() + i, values.begin() + std::min(size, i + batch));
+    for(int i = 0; i < size; i += batch)
+        removed += bulk.remove_bulk(values.begin() + i, values.begin() + std::min(size, i + batch));
+    end = std::chrono::high_resolution_clock::now();
+    std::cout << "bulk    : " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+              << " ms, lock acquisitions: " << 2 * ((size + batch - 1) / batch)
+              << ", added: " << added << ", removed: " << removed << std::endl;
+}
+
+
+/*
+    Cold start: n single inserts against the balanced bulk construction, sequential and split across threads
+    usage: ./executable build [size]
+*/
+void benchmarkBuild(int size){
+
+    std::vector<CustomType> sorted;
+    for(int i = 0; i < size; ++i)
+        sorted.push_back(CustomType(i));
+    // single inserts get shuffled keys, sorted ones would make the unbalanced tree a list
+    std::vector<CustomType> shuffled = sorted;
+    std::shuffle(begin(shuffled), end(shuffled), std::mt19937(437));
+
+    auto measure = [](const std::string& name, auto&& body){
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::setw(24) << std::left << name
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms" << std::endl;
+    };
+
+    mbu::ThreadSafeSet<CustomType> single;
+    measure("insert (shuffled)", [&](){
+        for(const CustomType& value : shuffled)
+            single.insert(value);
+    });
+
+    measure("constructor (sorted)", [&](){
+        mbu::ThreadSafeSet<CustomType> built(sorted.begin(), sorted.end());
+        if(built.size() != size)
+            std::cout << "size mismatch" << std::endl;
+    });
+
+    measure("constructor (shuffled)", [&](){
+        mbu::ThreadSafeSet<CustomType> built(shuffled.begin(), shuffled.end());
+    });
+
+    mbu::ThreadSafeSet<CustomType> rebuilt;
+    for(unsigned threads = 1; threads <= 8; threads *= 2){
+        measure("assign, " + std::to_string(threads) + " threads", [&](){
+            rebuilt.assign(sorted.begin(), sorted.end(), threads);
+        });
+    }
+}
+
+
+/*
+    Single thread per-op latency of insert, search and remove on shuffled keys
+    usage: ./executable ops [size]
+*/
+void benchmarkOps(int size){
+
+    std::vector<CustomType> values;
+    for(int i = 0; i < size; ++i)
+        values.push_back(CustomType(i));
+    std::shuffle(begin(values), end(values), std::mt19937(437));
+
+    auto measure = [](const std::string& name, int ops, auto&& body){
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::setw(8) << std::left << name
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / ops << " ns/op" << std::endl;
+    };
+
+    mbu::ThreadSafeSet<CustomType> set;
+    measure("insert", size, [&](){
+        for(const CustomType& value : values)
+            set.insert(value);
+    });
+    measure("search", size, [&](){
+        for(const CustomType& value : values)
+            set.search(value);
+    });
+    measure("size", 1000, [&](){
+        for(int i = 0; i < 1000; ++i)
+            set.size();
+    });
+    measure("approx", 1000, [&](){
+        for(int i = 0; i < 1000; ++i)
+            set.approximate_size();
+    });
+    measure("remove", size, [&](){
+        for(const CustomType& value : values)
+            set.remove(value);
+    });
+}
+
+
+/*
+    Windowed lookups: range_for_each / count_range against filtering a full iterate
+    usage: ./executable range [size] [width]
+*/
+void benchmarkRange(int size, int width){
+
+    std::vector<CustomType> values;
+    for(int i = 0; i < size; ++i)
+        values.push_back(CustomType(i));
+    mbu::ThreadSafeSet<CustomType> set(values.begin(), values.end());
+
+    const int queries = 1000;
+    std::mt19937 eng(437);
+    std::uniform_int_distribution<int> dist(0, size - width);
+    std::vector<int> starts;
+    for(int i = 0; i < queries; ++i)
+        starts.push_back(dist(eng));
+
+    auto measure = [](const std::string& name, int ops, auto&& body){
+        auto start = std::chrono::high_resolution_clock::now();
+        long found = body();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::setw(16) << std::left << name
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / ops << " ns/query, "
+                  << found << " keys" << std::endl;
+    };
+
+    measure("iterate filter", queries / 10, [&](){
+        long found = 0;
+        for(int i = 0; i < queries / 10; ++i){
+            CustomType lo(starts[i]), hi(starts[i] + width);
+            set.iterate([&](const CustomType& value){
+                if(!(value < lo) && value < hi)
+                    ++found;
+            });
+        }
+        return found;
+    });
+    measure("range_for_each", queries, [&](){
+        long found = 0;
+        for(int start : starts)
+            set.range_for_each(CustomType(start), CustomType(start + width), [&found](const CustomType&){ ++found; });
+        return found;
+    });
+    measure("count_range", queries, [&](){
+        long found = 0;
+        for(int start : starts)
+            found += set.count_range(CustomType(start), CustomType(start + width));
+        return found;
+    });
+}
+
+
+/*
+    Full scan aggregation: std::function iterate, the visitor overload and parallel_iterate
+    usage: ./executable scan [size] [threads]
+*/
+void benchmarkScan(int size, int num_threads){
+
+    std::vector<CustomType> values;
+    for(int i = 0; i < size; ++i)
+        values.push_back(CustomType(i));
+    mbu::ThreadSafeSet<CustomType> set(values.begin(), values.end());
+
+    auto measure = [](const std::string& name, auto&& body){
+        auto start = std::chrono::high_resolution_clock::now();
+        long sum = body();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::setw(20) << std::left << name
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms, sum: " << sum << std::endl;
+    };
+
+    measure("std::function", [&](){
+        long sum = 0;
+        std::function<void(const CustomType&)> func = [&sum](const CustomType& value){ sum += value.x; };
+        set.iterate(func);
+        return sum;
+    });
+    measure("visitor", [&](){
+        long sum = 0;
+        set.iterate([&sum](const CustomType& value){ sum += value.x; });
+        return sum;
+    });
+    for(int threads = 2; threads <= num_threads; threads *= 2){
+        measure("parallel, " + std::to_string(threads) + " threads", [&](){
+            std::atomic<long> sum = 0;
+            set.parallel_iterate([&sum](const CustomType& value){ sum.fetch_add(value.x, std::memory_order_relaxed); }, threads);
+            return sum.load();
+        });
+    }
+}
+
+
+/*
+    Lock policies of a Global mode set: throughput and fairness (slowest / fastest thread) for a fixed time
+    per thread count, from below to above the core count
+*/
+template <class Lock>
+void measureLock(const std::string& name, int maxThreads){
+
+    const int keys = 1024;
+    mbu::ThreadSafeSet<CustomType, std::allocator<CustomType>, Lock> set;
+    for(int i = 0; i < keys; i += 2)
+        set.insert(CustomType(i));
+
+    for(int threads = 1; threads <= maxThreads; threads *= 2){
+
+        std::atomic<bool> stop = false;
+        std::vector<long> ops(threads, 0);
+        std::vector<std::thread> workers;
+        for(int t = 0; t < threads; ++t){
+            workers.emplace_back([&, t](){
+                std::mt19937 eng(t);
+                long done = 0;
+                while(!stop.load(std::memory_order_relaxed)){
+                    CustomType value(eng() % keys);
+                    if(eng() % 2)
+                        set.insert(value);
+                    else
+                        set.remove(value);
+                    ++done;
+                }
+                ops[t] = done;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        stop = true;
+        for(std::thread& worker : workers)
+            worker.join();
+
+        long total = 0;
+        for(long done : ops)
+            total += done;
+        auto [slowest, fastest] = std::minmax_element(ops.begin(), ops.end());
+        std::cout << std::setw(14) << std::left << name << std::setw(4) << std::right << threads << " threads  "
+                  << std::setw(10) << total * 5 << " ops/s  fairness "
+                  << std::fixed << std::setprecision(2) << (*fastest > 0 ? double(*slowest) / *fastest : 0.0) << std::endl;
+    }
+}
+
+void benchmarkLocks(int maxThreads){
+    std::cout << "cores: " << std::thread::hardware_concurrency() << std::endl;
+    measureLock<mbu::SpinLock>("SpinLock", maxThreads);
+    measureLock<mbu::BackoffLock>("BackoffLock", maxThreads);
+    measureLock<mbu::TicketLock>("TicketLock", maxThreads);
+    measureLock<mbu::McsLock>("McsLock", maxThreads);
+    measureLock<mbu::BlockingLock>("BlockingLock", maxThreads);
+}
+
+
+/*
+    Instrumented mixed workload, build with make stats
+    usage: ./executable stats [threads] [coupling]
+*/
+void printHistogram(const std::string& name, const mbu::Histogram& histogram){
+    std::cout << std::setw(16) << std::left << name << std::setw(10) << histogram.count()
+              << " p50 <= " << histogram.percentile(0.5) << ", p99 <= " << histogram.percentile(0.99)
+              << ", p99.9 <= " << histogram.percentile(0.999) << std::endl;
+}
+
+void benchmarkStats(int num_threads, mbu::LockMode mode){
+
+#ifndef MBU_SET_STATS
+    std::cout << "built without MBU_SET_STATS, every counter stays 0 (use make stats)" << std::endl;
+#endif
+
+    const int keys = 10000;
+    mbu::ThreadSafeSet<CustomType> set(mode, mbu::ReadMode::Optimistic);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < num_threads; ++t){
+        workers.emplace_back([&set, t](){
+            std::mt19937 eng(t);
+            for(int i = 0; i < 50000; ++i){
+                CustomType value(eng() % keys);
+                switch(eng() % 4){
+                    case 0: set.insert(value); break;
+                    case 1: set.remove(value); break;
+                    default: set.search(value); break;
+                }
+            }
+        });
+    }
+    for(std::thread& worker : workers)
+        worker.join();
+
+    mbu::SetStats stats = set.stats();
+    std::cout << "inserts " << stats.count(mbu::SetOp::Insert) << ", removes " << stats.count(mbu::SetOp::Remove)
+              << ", searches " << stats.count(mbu::SetOp::Search) << std::endl;
+    std::cout << "histogram       samples    (ns, nodes for depth)" << std::endl;
+    printHistogram("insert", stats.latencyOf(mbu::SetOp::Insert));
+    printHistogram("remove", stats.latencyOf(mbu::SetOp::Remove));
+    printHistogram("search", stats.latencyOf(mbu::SetOp::Search));
+    printHistogram("lock wait", stats.lockWait);
+    printHistogram("lock hold", stats.lockHold);
+    printHistogram("depth", stats.depth);
+    std::cout << "spins " << stats.spins << ", yields " << stats.yields
+              << ", read retries " << stats.readRetries << ", read fallbacks " << stats.readFallbacks << std::endl;
+}
+
+
+/*
+    Mixed insert/remove/contains workload, same for every set implementation
+    usage: ./executable [tree|coupling|combining|avl|skiplist|epoch|persistent|shards|hash|blink]
+*/
+template <class Set>
+void runWorkload(Set& set){
+
     constexpr int SIZE = 100000;
     std::vector<int> values(2*SIZE+1);
     std::iota(begin(values), end(values), 0);
@@ -21,13 +743,12 @@ int main(){
     int num_threads = 10;
     int chunk_size = SIZE / num_threads;
 
-    mbu::ThreadSafeSet<CustomType> set;
     std::vector<std::thread> insert_threads;
     std::vector<std::thread> remove_threads;
     std::vector<std::thread> contains_threads;
 
-    int added, removed, contains;
-    added = removed = contains = 0;
+    // bumped by several threads at once
+    std::atomic<int> added = 0, removed = 0, contains = 0;
 
     auto insertFoo_Lvalue = [&](int s, int e)-> void {
         for (int i = s; i < e; ++i) {
@@ -148,6 +869,147 @@ int main(){
     std::cout << "Size: " << set.size() << std::endl;
 
     std::cout << "Done!" << std::endl;
+}
+
+
+int main(int argc, char* argv[]){
+
+    if(argc > 1 && std::string(argv[1]) == "writers"){
+        int maxThreads = argc > 2 ? std::stoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+        benchmarkWriters(maxThreads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "balanced"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 1000000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+        benchmarkBalanced(size, num_threads);
+        return 0;
+    }
+    
+    if(argc > 1 && std::string(argv[1]) == "readers"){
+        benchmarkReaders(argc > 2 ? std::stoi(argv[2]) : 100000);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "snapshot"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+        benchmarkSnapshot(size, num_threads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "allocator"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+        int rounds = argc > 4 ? std::stoi(argv[4]) : 5;
+        benchmarkAllocator(size, num_threads, rounds);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "sharded"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+        benchmarkSharded(size, num_threads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "membership"){
+        benchmarkMembership(argc > 2 ? std::stoi(argv[2]) : 100000);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "map"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+        benchmarkMap(size, num_threads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "restart"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 1000000;
+        benchmarkRestart(size, argc > 3 ? argv[3] : "set.snapshot");
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "bulk"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int batch = argc > 3 ? std::stoi(argv[3]) : 1000;
+        benchmarkBulk(size, batch);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "build"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        benchmarkBuild(size);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "ops"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        benchmarkOps(size);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "range"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 100000;
+        int width = argc > 3 ? std::stoi(argv[3]) : 100;
+        benchmarkRange(size, width);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "scan"){
+        int size = argc > 2 ? std::stoi(argv[2]) : 1000000;
+        int num_threads = argc > 3 ? std::stoi(argv[3]) : 8;
+        benchmarkScan(size, num_threads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "locks"){
+        int maxThreads = argc > 2 ? std::stoi(argv[2]) : std::max(8u, 4 * std::thread::hardware_concurrency());
+        benchmarkLocks(maxThreads);
+        return 0;
+    }
+
+    if(argc > 1 && std::string(argv[1]) == "stats"){
+        int num_threads = argc > 2 ? std::stoi(argv[2]) : 4;
+        bool coupling = argc > 3 && std::string(argv[3]) == "coupling";
+        benchmarkStats(num_threads, coupling ? mbu::LockMode::Coupling : mbu::LockMode::Global);
+        return 0;
+    }
+
+    std::string setName = argc > 1 ? argv[1] : "tree";
+    if(setName == "skiplist"){
+        mbu::ConcurrentSkipListSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "avl"){
+        mbu::BalancedThreadSafeSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "epoch"){
+        mbu::EpochThreadSafeSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "persistent"){
+        mbu::PersistentThreadSafeSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "shards"){
+        mbu::ShardedThreadSafeSet<CustomType, 8> set;
+        runWorkload(set);
+    }else if(setName == "hash"){
+        mbu::ConcurrentHashSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "blink"){
+        mbu::BLinkTreeSet<CustomType> set;
+        runWorkload(set);
+    }else if(setName == "coupling"){
+        mbu::ThreadSafeSet<CustomType> set(mbu::LockMode::Coupling);
+        runWorkload(set);
+    }else if(setName == "combining"){
+        mbu::ThreadSafeSet<CustomType> set(mbu::LockMode::Combining);
+        runWorkload(set);
+    }else{
+        mbu::ThreadSafeSet<CustomType> set;
+        runWorkload(set);
+    }
 
     return 0;
 }
\ No newline at end of file
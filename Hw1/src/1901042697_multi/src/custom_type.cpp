@@ -12,4 +12,14 @@ bool CustomType::operator==(const CustomType& other) const {
 
 bool CustomType::operator<(const CustomType& other) const {
     return x < other.x;
-}
\ No newline at end of file
+}
+
+
+bool CustomType::operator==(int key) const {
+    return x == key;
+}
+
+
+bool CustomType::operator<(int key) const {
+    return x < key;
+}
@@ -0,0 +1,171 @@
+#include "../include/epoch.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+
+namespace mbu{
+
+namespace {
+
+constexpr std::size_t COLLECT_THRESHOLD = 128;
+
+struct Retired
+{
+    void* ptr;
+    void (*deleter)(void*);
+    std::uint64_t epoch;
+};
+
+// One per thread, reused after the thread exits. Kept on its own cache line, readers write state on every pin.
+struct alignas(64) ThreadRecord
+{
+    // (epoch << 1) | pinned
+    std::atomic<std::uint64_t> state{0};
+    std::atomic<bool> owned{true};
+    ThreadRecord* next = nullptr;
+
+    int nesting = 0;
+    std::vector<Retired> limbo;
+    // grows while a pinned thread holds the epoch back so retire does not rescan limbo every call
+    std::size_t collectAt = COLLECT_THRESHOLD;
+};
+
+std::atomic<std::uint64_t> globalEpoch{0};
+std::atomic<ThreadRecord*> records{nullptr};
+
+// Leftovers of exited threads
+std::mutex orphanMutex;
+std::vector<Retired> orphans;
+
+
+ThreadRecord* acquireRecord(){
+    for(ThreadRecord* record = records.load(); record != nullptr; record = record->next){
+        bool expected = false;
+        if(!record->owned.load() && record->owned.compare_exchange_strong(expected, true)){
+            return record;
+        }
+    }
+
+    ThreadRecord* record = new ThreadRecord();
+    ThreadRecord* head = records.load();
+    do{
+        record->next = head;
+    }while(!records.compare_exchange_weak(head, record));
+    return record;
+}
+
+
+struct ThreadHandle
+{
+    ThreadRecord* record = acquireRecord();
+
+    ~ThreadHandle(){
+        {
+            std::lock_guard<std::mutex> lock(orphanMutex);
+            orphans.insert(orphans.end(), record->limbo.begin(), record->limbo.end());
+        }
+        record->limbo.clear();
+        record->nesting = 0;
+        record->state.store(0);
+        record->owned.store(false);
+    }
+};
+
+
+ThreadRecord& localRecord(){
+    thread_local ThreadHandle handle;
+    return *handle.record;
+}
+
+
+// The epoch moves only when every pinned thread has seen the current one
+bool tryAdvance(){
+    std::uint64_t epoch = globalEpoch.load();
+    for(ThreadRecord* record = records.load(); record != nullptr; record = record->next){
+        std::uint64_t state = record->state.load();
+        if((state & 1) && (state >> 1) != epoch){
+            return false;
+        }
+    }
+    return globalEpoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+
+void reclaim(std::vector<Retired>& list, std::uint64_t epoch){
+    auto expired = std::partition(list.begin(), list.end(), [epoch](const Retired& retired){
+        return retired.epoch + 2 > epoch;
+    });
+    for(auto it = expired; it != list.end(); ++it){
+        it->deleter(it->ptr);
+    }
+    list.erase(expired, list.end());
+}
+
+
+// Runs after every thread is gone, thread locals of the main thread are destroyed before the statics
+struct Reaper
+{
+    ~Reaper(){
+        for(Retired& retired : orphans){
+            retired.deleter(retired.ptr);
+        }
+        ThreadRecord* record = records.load();
+        while(record != nullptr){
+            ThreadRecord* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+} reaper;
+
+} // namespace
+
+
+Epoch::Guard::Guard(){
+    ThreadRecord& record = localRecord();
+    if(record.nesting++ == 0){
+        record.state.store((globalEpoch.load() << 1) | 1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+
+Epoch::Guard::~Guard(){
+    ThreadRecord& record = localRecord();
+    if(--record.nesting == 0){
+        record.state.store(record.state.load(std::memory_order_relaxed) & ~std::uint64_t(1), std::memory_order_release);
+    }
+}
+
+
+void Epoch::retire(void* ptr, void (*deleter)(void*)){
+    ThreadRecord& record = localRecord();
+    record.limbo.push_back({ptr, deleter, globalEpoch.load()});
+    if(record.limbo.size() >= record.collectAt){
+        collect();
+        record.collectAt = std::max(COLLECT_THRESHOLD, 2 * record.limbo.size());
+    }
+}
+
+
+void Epoch::collect(){
+    tryAdvance();
+    std::uint64_t epoch = globalEpoch.load();
+
+    reclaim(localRecord().limbo, epoch);
+
+    std::unique_lock<std::mutex> lock(orphanMutex, std::try_to_lock);
+    if(lock.owns_lock()){
+        reclaim(orphans, epoch);
+    }
+}
+
+
+std::uint64_t Epoch::current(){
+    return globalEpoch.load();
+}
+
+} // namespace mbu
@@ -0,0 +1,84 @@
+#include "../include/locks.hpp"
+
+#include <memory>
+#include <vector>
+
+
+namespace mbu{
+
+namespace {
+
+// Queue nodes of one thread. A node is only referenced while its lock is held or waited on, so it is
+// reusable right after unlock and the pool can free everything when the thread exits.
+struct NodePool
+{
+    McsLock::QNode* free = nullptr;
+    std::vector<std::unique_ptr<McsLock::QNode>> owned;
+};
+
+thread_local NodePool pool;
+
+} // namespace
+
+
+McsLock::QNode* McsLock::acquireNode(){
+    if(QNode* node = pool.free){
+        pool.free = node->free;
+        return node;
+    }
+    pool.owned.push_back(std::make_unique<QNode>());
+    return pool.owned.back().get();
+}
+
+
+void McsLock::releaseNode(QNode* node){
+    node->free = pool.free;
+    pool.free = node;
+}
+
+
+void McsLock::lock(){
+
+    QNode* node = acquireNode();
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->locked.store(true, std::memory_order_relaxed);
+
+    QNode* predecessor = tail.exchange(node, std::memory_order_acq_rel);
+    if(predecessor != nullptr){
+        predecessor->next.store(node, std::memory_order_release);
+        int spins = 0;
+        while(node->locked.load(std::memory_order_acquire)){
+            noteSpin();
+            if(++spins < SPIN_LIMIT){
+                cpuRelax();
+            }else{
+                noteYield();
+                std::this_thread::yield();
+            }
+        }
+    }
+    owner = node;
+}
+
+
+void McsLock::unlock(){
+
+    QNode* node = owner;
+    QNode* successor = node->next.load(std::memory_order_acquire);
+    if(successor == nullptr){
+        QNode* expected = node;
+        if(tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)){
+            releaseNode(node);
+            return;
+        }
+        // a waiter swapped itself into tail but has not linked in yet
+        while((successor = node->next.load(std::memory_order_acquire)) == nullptr){
+            noteSpin();
+            cpuRelax();
+        }
+    }
+    successor->locked.store(false, std::memory_order_release);
+    releaseNode(node);
+}
+
+} // namespace mbu
@@ -0,0 +1,49 @@
+#include "../include/scalable_counter.hpp"
+
+#include <algorithm>
+
+
+namespace mbu{
+
+// Threads are spread over the stripes round robin in the order they first count
+int ScalableCounter::stripeIndex(){
+    static std::atomic<int> next = 0;
+    thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    return index;
+}
+
+
+void ScalableCounter::add(long delta){
+    Stripe& stripe = stripes[stripeIndex()];
+    long local = stripe.value.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if(local >= SYNC_THRESHOLD || local <= -SYNC_THRESHOLD){
+        // total first, a concurrent exact() may then count the folded part twice but never misses it
+        total.fetch_add(local);
+        stripe.value.fetch_sub(local);
+    }
+}
+
+
+long ScalableCounter::exact() const {
+    long sum = 0;
+    for(const Stripe& stripe : stripes){
+        sum += stripe.value.load();
+    }
+    return std::max(0L, sum + total.load());
+}
+
+
+// Removals still sitting in the stripes can push the total below zero
+long ScalableCounter::approximate() const {
+    return std::max(0L, total.load(std::memory_order_relaxed));
+}
+
+
+void ScalableCounter::reset(long value){
+    for(Stripe& stripe : stripes){
+        stripe.value.store(0, std::memory_order_relaxed);
+    }
+    total.store(value, std::memory_order_relaxed);
+}
+
+} // namespace mbu
@@ -0,0 +1,233 @@
+#include "../include/slab_allocator.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+
+namespace mbu{
+
+namespace {
+
+constexpr std::size_t NUM_CLASSES = SlabPool::MAX_BLOCK / SlabPool::ALIGNMENT;
+
+// A thread keeps at most this many free blocks per class before moving them to the depot
+constexpr std::size_t LOCAL_LIMIT = 4096;
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+// A chain of free blocks moved between a thread and the depot in one step
+struct Batch
+{
+    FreeBlock* head = nullptr;
+    FreeBlock* tail = nullptr;
+    std::size_t count = 0;
+};
+
+struct Depot
+{
+    std::mutex mutex;
+    std::vector<Batch> batches;
+};
+
+/*
+    The shared state is never destroyed. Blocks can still come back after a thread's cache is gone or during
+    static destruction, e.g. nodes retired to Epoch that its reaper frees at exit.
+*/
+Depot* const depots = new Depot[NUM_CLASSES];
+
+std::atomic<std::uint64_t> slabCount{0};
+
+std::size_t classOf(std::size_t size){
+    return (std::max<std::size_t>(size, 1) - 1) / SlabPool::ALIGNMENT;
+}
+
+
+struct ThreadCache;
+
+// Live caches are summed by stats(), the counts of exited threads are kept in retiredStats
+std::mutex& registryMutex = *new std::mutex;
+std::vector<ThreadCache*>& registry = *new std::vector<ThreadCache*>;
+SlabStats retiredStats;
+
+// Set once the calling thread's cache is destroyed, trivially destructible so it stays readable until the end
+thread_local bool cacheDestroyed = false;
+
+
+struct ThreadCache
+{
+    Batch lists[NUM_CLASSES];
+    char* bump[NUM_CLASSES] = {};
+    char* bumpEnd[NUM_CLASSES] = {};
+
+    // written by the owner only, atomic so stats() can read them from any thread
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> deallocations{0};
+
+    ThreadCache(){
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(this);
+    }
+
+    ~ThreadCache(){
+        for(std::size_t c = 0; c < NUM_CLASSES; ++c){
+            std::size_t blockSize = (c + 1) * SlabPool::ALIGNMENT;
+            while(bump[c] != nullptr && bump[c] + blockSize <= bumpEnd[c]){
+                push(c, bump[c]);
+                bump[c] += blockSize;
+            }
+            flush(c);
+        }
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(std::find(registry.begin(), registry.end(), this));
+        retiredStats.allocations += allocations.load();
+        retiredStats.deallocations += deallocations.load();
+        cacheDestroyed = true;
+    }
+
+    void push(std::size_t c, void* ptr){
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        Batch& list = lists[c];
+        block->next = list.head;
+        list.head = block;
+        if(list.tail == nullptr){
+            list.tail = block;
+        }
+        ++list.count;
+    }
+
+    void* pop(std::size_t c){
+        Batch& list = lists[c];
+        FreeBlock* block = list.head;
+        list.head = block->next;
+        if(list.head == nullptr){
+            list.tail = nullptr;
+        }
+        --list.count;
+        return block;
+    }
+
+    void flush(std::size_t c){
+        if(lists[c].count == 0){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(depots[c].mutex);
+            depots[c].batches.push_back(lists[c]);
+        }
+        lists[c] = Batch();
+    }
+
+    void* refill(std::size_t c){
+
+        {
+            std::lock_guard<std::mutex> lock(depots[c].mutex);
+            if(!depots[c].batches.empty()){
+                lists[c] = depots[c].batches.back();
+                depots[c].batches.pop_back();
+            }
+        }
+        if(lists[c].count != 0){
+            return pop(c);
+        }
+
+        std::size_t blockSize = (c + 1) * SlabPool::ALIGNMENT;
+        if(bump[c] == nullptr || bump[c] + blockSize > bumpEnd[c]){
+            bump[c] = static_cast<char*>(::operator new(SlabPool::SLAB_SIZE));
+            bumpEnd[c] = bump[c] + SlabPool::SLAB_SIZE;
+            slabCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        void* block = bump[c];
+        bump[c] += blockSize;
+        return block;
+    }
+};
+
+
+ThreadCache& localCache(){
+    thread_local ThreadCache cache;
+    return cache;
+}
+
+
+// Late blocks skip the (destroyed) cache and go to and from the depot one at a time
+void* lateAllocate(std::size_t c){
+    {
+        std::lock_guard<std::mutex> lock(depots[c].mutex);
+        if(!depots[c].batches.empty()){
+            Batch& batch = depots[c].batches.back();
+            FreeBlock* block = batch.head;
+            batch.head = block->next;
+            if(--batch.count == 0){
+                depots[c].batches.pop_back();
+            }
+            return block;
+        }
+    }
+    return ::operator new((c + 1) * SlabPool::ALIGNMENT);
+}
+
+void lateDeallocate(std::size_t c, void* ptr){
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = nullptr;
+    std::lock_guard<std::mutex> lock(depots[c].mutex);
+    depots[c].batches.push_back(Batch{block, block, 1});
+}
+
+} // namespace
+
+
+void* SlabPool::allocate(std::size_t size){
+    std::size_t c = classOf(size);
+    if(cacheDestroyed){
+        return lateAllocate(c);
+    }
+    ThreadCache& cache = localCache();
+    cache.allocations.store(cache.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return cache.lists[c].count != 0 ? cache.pop(c) : cache.refill(c);
+}
+
+
+void SlabPool::deallocate(void* ptr, std::size_t size) noexcept {
+    std::size_t c = classOf(size);
+    if(cacheDestroyed){
+        lateDeallocate(c, ptr);
+        return;
+    }
+    ThreadCache& cache = localCache();
+    cache.deallocations.store(cache.deallocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    cache.push(c, ptr);
+    if(cache.lists[c].count >= LOCAL_LIMIT){
+        cache.flush(c);
+    }
+}
+
+
+void SlabPool::release(){
+    if(cacheDestroyed){
+        return;
+    }
+    ThreadCache& cache = localCache();
+    for(std::size_t c = 0; c < NUM_CLASSES; ++c){
+        cache.flush(c);
+    }
+}
+
+
+SlabStats SlabPool::stats(){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    SlabStats result = retiredStats;
+    for(ThreadCache* cache : registry){
+        result.allocations += cache->allocations.load(std::memory_order_relaxed);
+        result.deallocations += cache->deallocations.load(std::memory_order_relaxed);
+    }
+    result.slabs = slabCount.load(std::memory_order_relaxed);
+    return result;
+}
+
+} // namespace mbu
@@ -0,0 +1,159 @@
+#include "../include/snapshot_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace mbu{
+
+namespace {
+
+constexpr std::uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ull;
+// a single write() moves at most about 2 GB on Linux
+constexpr std::size_t WRITE_CHUNK = std::size_t(1) << 30;
+
+std::system_error fileError(const std::string& what, const std::string& path){
+    return std::system_error(errno, std::generic_category(), what + " " + path);
+}
+
+void writeAll(int fd, const void* data, std::size_t bytes, const std::string& path){
+    const char* next = static_cast<const char*>(data);
+    while(bytes != 0){
+        ssize_t written = ::write(fd, next, bytes < WRITE_CHUNK ? bytes : WRITE_CHUNK);
+        if(written < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            throw fileError("can not write", path);
+        }
+        next += written;
+        bytes -= static_cast<std::size_t>(written);
+    }
+}
+
+} // namespace
+
+
+std::uint64_t snapshotChecksum(const void* data, std::size_t bytes){
+    const unsigned char* next = static_cast<const unsigned char*>(data);
+    std::uint64_t hash = bytes * MULTIPLIER;
+    for(; bytes >= 8; bytes -= 8, next += 8){
+        std::uint64_t word;
+        std::memcpy(&word, next, 8);
+        hash = (hash ^ word) * MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+    if(bytes != 0){
+        std::uint64_t word = 0;
+        std::memcpy(&word, next, bytes);
+        hash = (hash ^ word) * MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+
+void writeSnapshot(const std::string& path, const void* keys, std::uint64_t count, std::uint32_t keySize){
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic));
+    header.version = SnapshotHeader::VERSION;
+    header.keySize = keySize;
+    header.count = count;
+    header.checksum = snapshotChecksum(keys, count * keySize);
+
+    // written aside and renamed over path, readers see the old file or the whole new one
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        throw fileError("can not create", temporary);
+    }
+    try{
+        writeAll(fd, &header, sizeof(header), temporary);
+        writeAll(fd, keys, count * keySize, temporary);
+        if(::fsync(fd) != 0){
+            throw fileError("can not sync", temporary);
+        }
+    }catch(...){
+        ::close(fd);
+        ::unlink(temporary.c_str());
+        throw;
+    }
+    ::close(fd);
+    if(::rename(temporary.c_str(), path.c_str()) != 0){
+        std::system_error error = fileError("can not rename to", path);
+        ::unlink(temporary.c_str());
+        throw error;
+    }
+}
+
+
+MappedSnapshot::MappedSnapshot(const std::string& path, std::uint32_t keySize){
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw fileError("can not open", path);
+    }
+    struct stat status;
+    if(::fstat(fd, &status) != 0){
+        std::system_error error = fileError("can not stat", path);
+        ::close(fd);
+        throw error;
+    }
+    if(static_cast<std::size_t>(status.st_size) < sizeof(SnapshotHeader)){
+        ::close(fd);
+        throw std::runtime_error(path + ": too short for a snapshot");
+    }
+
+    bytes = static_cast<std::size_t>(status.st_size);
+    data = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED){
+        data = nullptr;
+        throw fileError("can not map", path);
+    }
+    // the build reads every key once, have the kernel read ahead
+    ::madvise(data, bytes, MADV_WILLNEED);
+
+    auto reject = [&](const std::string& reason){
+        ::munmap(data, bytes);
+        data = nullptr;
+        return std::runtime_error(path + ": " + reason);
+    };
+
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    std::size_t payload = bytes - sizeof(SnapshotHeader);
+    if(std::memcmp(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic)) != 0){
+        throw reject("not a snapshot file");
+    }
+    if(header.version != SnapshotHeader::VERSION){
+        throw reject("unsupported snapshot version " + std::to_string(header.version));
+    }
+    if(header.keySize != keySize){
+        throw reject("holds " + std::to_string(header.keySize) + " byte keys, expected " + std::to_string(keySize));
+    }
+    if(header.count != payload / keySize || payload % keySize != 0){
+        throw reject("size does not match its key count, the file is truncated");
+    }
+    if(snapshotChecksum(keys(), payload) != header.checksum){
+        throw reject("checksum mismatch, the file is corrupted");
+    }
+    keyCount = header.count;
+}
+
+
+MappedSnapshot::~MappedSnapshot(){
+    if(data != nullptr){
+        ::munmap(data, bytes);
+    }
+}
+
+} // namespace mbu
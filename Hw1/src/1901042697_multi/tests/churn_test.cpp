@@ -0,0 +1,164 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+#include "../include/thread_safe_set.hpp"
+#include "../include/balanced_thread_safe_set.hpp"
+#include "../include/concurrent_skip_list_set.hpp"
+#include "../include/epoch_thread_safe_set.hpp"
+#include "../include/concurrent_map.hpp"
+
+
+/*
+    Keys that stay in the set must never be missed while other keys are removed around them.
+
+    Every round fills a fresh set with the even (stable) and odd (churned) keys in random order, so many odd keys
+    sit above even ones. Writers then remove and put back the odd keys; removing one with two children moves its
+    successor, an even key, into its place. Readers meanwhile look up the even keys and walk the set in order.
+    usage: ./churn_test [ms per set]
+*/
+
+constexpr int KEYS = 4000;
+constexpr int WRITERS = 2;
+constexpr int READERS = 2;
+
+int failures = 0;
+
+
+// ConcurrentMap through the set interface, its entries are move-only so a remove relinks the successor's node itself
+struct MapSet
+{
+    mbu::ConcurrentMap<int, int> map{mbu::LockMode::Coupling};
+
+    bool insert(int key){
+        return map.try_emplace(key, key);
+    }
+
+    bool remove(int key){
+        return map.erase(key);
+    }
+
+    bool search(int key) const {
+        return map.find(key) == key;
+    }
+
+    template <class F>
+    void iterate(F&& f) const {
+        map.iterate([&f](int key, const int&){ f(key); });
+    }
+};
+
+
+template <class Set, class Make>
+void churn(const std::string& name, Make make, int ms){
+
+    std::mt19937 eng(437);
+    std::vector<int> keys(2 * KEYS);
+    std::iota(keys.begin(), keys.end(), 0);
+
+    long probes = 0;
+    long misses = 0;
+    long badScans = 0;
+    int rounds = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while(rounds == 0 || std::chrono::steady_clock::now() < deadline){
+
+        Set set = make();
+        std::shuffle(keys.begin(), keys.end(), eng);
+        for(int key : keys){
+            set.insert(key);
+        }
+
+        std::atomic<bool> stop = false;
+        std::atomic<long> roundProbes = 0;
+        std::atomic<long> roundMisses = 0;
+        std::atomic<long> roundBadScans = 0;
+
+        std::vector<std::thread> threads;
+        for(int t = 0; t < WRITERS; ++t){
+            threads.emplace_back([&, t](){
+                std::vector<int> odd;
+                for(int key : keys){
+                    if(key % 2 == 1 && key / 2 % WRITERS == t){
+                        odd.push_back(key);
+                    }
+                }
+                for(int key : odd){
+                    set.remove(key);
+                }
+                for(int key : odd){
+                    set.insert(key);
+                }
+                stop.store(true);
+            });
+        }
+        for(int t = 0; t < READERS; ++t){
+            threads.emplace_back([&, t](){
+                long probed = 0;
+                long missed = 0;
+                for(int key = 2 * t; !stop.load(); key = (key + 2 * READERS) % (2 * KEYS)){
+                    ++probed;
+                    missed += !set.search(key);
+                }
+                roundProbes += probed;
+                roundMisses += missed;
+            });
+        }
+        threads.emplace_back([&](){
+            while(!stop.load()){
+                // ascending, every even key exactly once
+                int previous = -1;
+                int nextEven = 0;
+                bool exact = true;
+                set.iterate([&](int key){
+                    exact = exact && key > previous;
+                    previous = key;
+                    if(key % 2 == 0){
+                        exact = exact && key == nextEven;
+                        nextEven += 2;
+                    }
+                });
+                roundBadScans += !exact || nextEven != 2 * KEYS;
+            }
+        });
+        for(std::thread& thread : threads){
+            thread.join();
+        }
+
+        probes += roundProbes;
+        misses += roundMisses;
+        badScans += roundBadScans;
+        ++rounds;
+    }
+
+    std::cout << name << ": " << rounds << " rounds, " << misses << " misses in " << probes << " probes, "
+              << badScans << " bad scans" << std::endl;
+    if(misses != 0 || badScans != 0){
+        ++failures;
+    }
+}
+
+
+int main(int argc, char* argv[]){
+
+    int ms = argc > 1 ? std::stoi(argv[1]) : 1000;
+
+    using mbu::LockMode;
+    using mbu::ReadMode;
+    churn<mbu::ThreadSafeSet<int>>("global shared", [](){ return mbu::ThreadSafeSet<int>(LockMode::Global, ReadMode::Shared); }, ms);
+    churn<mbu::ThreadSafeSet<int>>("coupling shared", [](){ return mbu::ThreadSafeSet<int>(LockMode::Coupling, ReadMode::Shared); }, ms);
+    churn<mbu::ThreadSafeSet<int>>("coupling optimistic", [](){ return mbu::ThreadSafeSet<int>(LockMode::Coupling, ReadMode::Optimistic); }, ms);
+    churn<mbu::ThreadSafeSet<int>>("combining shared", [](){ return mbu::ThreadSafeSet<int>(LockMode::Combining, ReadMode::Shared); }, ms);
+    churn<MapSet>("map", [](){ return MapSet(); }, ms);
+    churn<mbu::BalancedThreadSafeSet<int>>("balanced", [](){ return mbu::BalancedThreadSafeSet<int>(); }, ms);
+    churn<mbu::EpochThreadSafeSet<int>>("epoch", [](){ return mbu::EpochThreadSafeSet<int>(); }, ms);
+    churn<mbu::ConcurrentSkipListSet<int>>("skip list", [](){ return mbu::ConcurrentSkipListSet<int>(); }, ms);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "../include/concurrent_hash_set.hpp"
+
+
+/*
+    Lookups of keys that stay in the set must never miss while the table is resized under them.
+
+    Every round fills a fresh set with the stable keys, then one writer inserts enough new keys to double the table
+    a few times while the readers look up the stable keys; a resize copies a chunk of slots at a time, so readers
+    meet probe chains that are partly copied. Finally the new keys are removed again and the stable ones checked.
+    usage: ./hash_resize_test [ms]
+*/
+
+constexpr int STABLE = 20000;
+constexpr int GROWTH = 8 * STABLE;
+constexpr int READERS = 3;
+
+
+int main(int argc, char* argv[]){
+
+    int ms = argc > 1 ? std::stoi(argv[1]) : 1000;
+
+    long probes = 0;
+    long misses = 0;
+    long lost = 0;
+    int rounds = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while(rounds == 0 || std::chrono::steady_clock::now() < deadline){
+
+        mbu::ConcurrentHashSet<int> set;
+        for(int key = 0; key < STABLE; ++key){
+            set.insert(key);
+        }
+
+        std::atomic<bool> stop = false;
+        std::atomic<long> roundProbes = 0;
+        std::atomic<long> roundMisses = 0;
+
+        std::vector<std::thread> threads;
+        threads.emplace_back([&](){
+            for(int key = STABLE; key < STABLE + GROWTH; ++key){
+                set.insert(key);
+            }
+            stop.store(true);
+        });
+        for(int t = 0; t < READERS; ++t){
+            threads.emplace_back([&, t](){
+                long probed = 0;
+                long missed = 0;
+                for(int key = t; !stop.load(); key = (key + READERS) % STABLE){
+                    ++probed;
+                    missed += !set.search(key);
+                }
+                roundProbes += probed;
+                roundMisses += missed;
+            });
+        }
+        for(std::thread& thread : threads){
+            thread.join();
+        }
+
+        for(int key = STABLE; key < STABLE + GROWTH; ++key){
+            set.remove(key);
+        }
+        for(int key = 0; key < STABLE; ++key){
+            lost += !set.search(key);
+        }
+        lost += set.size() != STABLE;
+
+        probes += roundProbes;
+        misses += roundMisses;
+        ++rounds;
+    }
+
+    std::cout << "hash resize: " << rounds << " rounds, " << misses << " misses in " << probes << " probes, "
+              << lost << " lost" << std::endl;
+    return misses == 0 && lost == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+#include <string>
+#include <random>
+#include <memory>
+
+#include "../include/concurrent_map.hpp"
+#include "../include/custom_type.hpp"
+
+
+/*
+    ConcurrentMap against std::map one operation at a time, then per key counters under concurrent compute:
+    every compute must land exactly once while other keys are erased and put back around them.
+    Also run under TSan by make tsan.
+*/
+
+int failures = 0;
+
+#define CHECK(condition) \
+    if(!(condition)){\
+        std::cout << "FAIL " #condition " line " << __LINE__ << std::endl;\
+        ++failures;\
+    }\
+
+
+void sequential(mbu::ConcurrentMap<int, std::string>& map){
+
+    std::map<int, std::string> reference;
+    std::mt19937 eng(3);
+    for(int i = 0; i < 20000; ++i){
+        int key = eng() % 500;
+        std::string value = std::to_string(eng() % 1000);
+        switch(eng() % 5){
+            case 0:
+                CHECK(map.insert_or_assign(key, value) == reference.insert_or_assign(key, value).second);
+                break;
+            case 1:
+                CHECK(map.try_emplace(key, value) == reference.try_emplace(key, value).second);
+                break;
+            case 2: {
+                bool added = reference.count(key) == 0;
+                reference[key] += "x";
+                CHECK(map.compute(key, [](std::string& s){ s += "x"; }) == added);
+                break;
+            }
+            case 3:
+                CHECK(map.erase(key) == (reference.erase(key) == 1));
+                break;
+            default: {
+                auto it = reference.find(key);
+                CHECK(map.find(key) == (it != reference.end() ? std::optional<std::string>(it->second) : std::nullopt));
+                break;
+            }
+        }
+    }
+    CHECK(map.size() == static_cast<int>(reference.size()));
+
+    auto it = reference.begin();
+    bool same = true;
+    map.iterate([&](int key, const std::string& value){
+        same = same && it != reference.end() && it->first == key && it->second == value;
+        ++it;
+    });
+    CHECK(same && it == reference.end());
+
+    map.clear();
+    CHECK(map.empty());
+}
+
+
+void counters(mbu::ConcurrentMap<int, std::string>& map){
+
+    constexpr int THREADS = 6;
+    constexpr int OPS = 20000;
+    constexpr int KEYS = 64;
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < THREADS; ++t){
+        threads.emplace_back([&map, t](){
+            std::mt19937 eng(t);
+            for(int i = 0; i < OPS; ++i){
+                int key = eng() % KEYS;
+                map.compute(key, [](std::string& s){ s.push_back('a'); });
+                if(i % 7 == 0){
+                    map.find(key);
+                }
+                // churn the keys above KEYS so the counters' nodes are relinked under the computes
+                if(i % 11 == 0){
+                    map.erase(KEYS + key);
+                }
+                if(i % 5 == 0){
+                    map.insert_or_assign(KEYS + key, std::string(40, 'q'));
+                }
+            }
+        });
+    }
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+
+    long total = 0;
+    map.iterate([&total](int key, const std::string& value){
+        if(key < KEYS){
+            total += static_cast<long>(value.size());
+        }
+    });
+    CHECK(total == static_cast<long>(THREADS) * OPS);
+}
+
+
+int main(){
+
+    for(mbu::LockMode mode : {mbu::LockMode::Global, mbu::LockMode::Coupling}){
+        mbu::ConcurrentMap<int, std::string> map(mode);
+        sequential(map);
+        counters(map);
+    }
+
+    // heterogeneous lookups
+    mbu::ConcurrentMap<CustomType, int> custom;
+    custom.insert_or_assign(CustomType(3), 7);
+    CHECK(custom.find(3) == 7 && custom.find(CustomType(3)) == 7 && custom.contains(3) && !custom.contains(4));
+
+    // move-only values
+    mbu::ConcurrentMap<int, std::unique_ptr<int>> owned;
+    owned.try_emplace(1, std::make_unique<int>(5));
+    owned.compute(1, [](std::unique_ptr<int>& p){ ++*p; });
+    owned.compute(2, [](std::unique_ptr<int>& p){ p = std::make_unique<int>(9); });
+    int sum = 0;
+    owned.iterate([&sum](int, const std::unique_ptr<int>& p){ sum += *p; });
+    CHECK(sum == 15);
+
+    std::cout << "map: " << (failures == 0 ? "ok" : "FAILED") << std::endl;
+    return failures == 0 ? 0 : 1;
+}